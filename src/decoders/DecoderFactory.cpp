@@ -3,6 +3,7 @@
 
 #include "SmartImageDecoder.hpp"
 #include "SmartJpegDecoder.hpp"
+#include "SmartRawDecoder.hpp"
 #include "SmartPngDecoder.hpp"
 #include "SmartTiffDecoder.hpp"
 #include "SmartJxlDecoder.hpp"
@@ -10,7 +11,6 @@
 #include "Image.hpp"
 
 #include <QFile>
-#include <QImageReader>
 #include <QDebug>
 
 
@@ -24,19 +24,48 @@ DecoderFactory *DecoderFactory::globalInstance()
     return &fac;
 }
 
-bool DecoderFactory::hasCR2Header(const QFileInfo &url)
+namespace
+{
+// the number of bytes read for determining the format of a file
+constexpr qint64 SniffLength = 64;
+
+struct MagicNumber
+{
+    const char *bytes;
+    int length;
+    const char *format;
+};
+
+const MagicNumber magicNumbers[] =
+{
+    { "\xFF\xD8\xFF", 3, "jpeg" },
+    { "\x89PNG\r\n\x1A\n", 8, "png" },
+    { "II*\0", 4, "tiff" },
+    { "MM\0*", 4, "tiff" },
+    // BigTIFF
+    { "II+\0", 4, "tiff" },
+    { "MM\0+", 4, "tiff" },
+    // JPEG XL codestream and container
+    { "\xFF\x0A", 2, "jxl" },
+    { "\0\0\0\x0CJXL \r\n\x87\n", 12, "jxl" },
+};
+
+// reads the first bytes of a file with a single unbuffered read
+QByteArray readHeader(const QFileInfo &url, qint64 length)
 {
     QFile file(url.absoluteFilePath());
 
-    if(!file.open(QIODevice::ReadOnly))
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
     {
-        return false;
+        return QByteArray();
     }
 
-    char b[12];
-    QDataStream istream(&file);
+    return file.read(length);
+}
 
-    if(istream.readRawData(b, sizeof(b) / sizeof(*b)) == -1)
+bool isCR2Header(const QByteArray &b)
+{
+    if(b.size() < 12)
     {
         return false;
     }
@@ -71,6 +100,35 @@ bool DecoderFactory::hasCR2Header(const QFileInfo &url)
 
     return false;
 }
+}
+
+bool DecoderFactory::hasCR2Header(const QFileInfo &url)
+{
+    return isCR2Header(readHeader(url, 12));
+}
+
+// Determines the format of a file by its magic number, reading no more than its first few bytes. Returns an empty array if unknown.
+QByteArray DecoderFactory::sniffFormat(const QFileInfo &url)
+{
+    QByteArray header = readHeader(url, SniffLength);
+
+    // CR2 is TIFF-based, but cannot be decoded as such. It's not reported either, as RAWs are recognized by their file extension only,
+    // see Image::isRaw(), so that there is no decoder for an extensionless RAW.
+    if(isCR2Header(header))
+    {
+        return QByteArray();
+    }
+
+    for(const MagicNumber &m : magicNumbers)
+    {
+        if(header.startsWith(QByteArrayView(m.bytes, m.length)))
+        {
+            return QByteArray(m.format);
+        }
+    }
+
+    return QByteArray();
+}
 
 QSharedPointer<Image> DecoderFactory::makeImage(const QFileInfo &url)
 {
@@ -101,8 +159,7 @@ std::unique_ptr<SmartImageDecoder> DecoderFactory::getDecoder(const QSharedPoint
         if(formatHint.isEmpty())
         {
             qInfo() << "Could not determine file extension for file " << image->fileInfo().fileName();
-            QImageReader r(info.absoluteFilePath());
-            format = r.format();
+            format = this->sniffFormat(info);
             qDebug() << "Determined format " << format << " for file " << image->fileInfo().fileName();
         }
         else
@@ -110,7 +167,11 @@ std::unique_ptr<SmartImageDecoder> DecoderFactory::getDecoder(const QSharedPoint
             format = formatHint.toLocal8Bit();
         }
 
-        if(image->isRaw() || format == "jpeg" || format == "jpg")
+        if(image->isRaw())
+        {
+            return std::make_unique<SmartRawDecoder>(image);
+        }
+        else if(format == "jpeg" || format == "jpg")
         {
             return std::make_unique<SmartJpegDecoder>(image);
         }
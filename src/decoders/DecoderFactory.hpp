@@ -18,6 +18,7 @@ public:
 
     ~DecoderFactory();
     bool hasCR2Header(const QFileInfo &url);
+    QByteArray sniffFormat(const QFileInfo &url);
     QSharedPointer<Image> makeImage(const QFileInfo &url);
     std::unique_ptr<SmartImageDecoder> getDecoder(const QSharedPointer<Image> &image);
     std::unique_ptr<SmartImageDecoder> getDecoder(const QSharedPointer<Image> &image, const QString &formatHint);
@@ -4,6 +4,9 @@
 #include "Formatter.hpp"
 #include "rawfiles.h"
 
+#include <atomic>
+#include <cmath>
+
 // libraw basically include the entire Windoof API, messing up any C++ source code that uses std::min
 #include <libraw.h>
 #include <libraw_version.h>
@@ -13,52 +16,183 @@
 #endif
 
 static const QStringList rawFiles = QString::fromLatin1(raw_file_extentions).remove(QLatin1String("*.")).split(QLatin1Char(' '));
+static std::atomic<bool> demosaicEnabled = false;
 
-void LibRawHelper::extractThumbnail(QByteArray& encodedThumbnailOut, const void* fileBuf, qint64 buflen)
+#if LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0, 21)
+// the entry of the thumbnail list which LibRaw has chosen as default preview, -1 if it's not a JPEG
+static int defaultPreviewIndex(const LibRaw& raw)
 {
-	LibRaw raw;
-            
-	int ret = raw.open_buffer(const_cast<void*>(fileBuf), buflen);
-	if (ret != LIBRAW_SUCCESS)
+	if (raw.imgdata.thumbnail.tformat != LIBRAW_THUMBNAIL_JPEG)
 	{
-		throw std::runtime_error(Formatter () << "LibRaw: failed to run open_buffer: " << libraw_strerror(ret));
+		return -1;
 	}
 
-	auto loadEmbeddedPreview = [](QByteArray& imgData, LibRaw& raw)
+	const libraw_thumbnail_list_t& list = raw.imgdata.thumbs_list;
+	for (int i = 0; i < list.thumbcount; i++)
 	{
-		int ret = raw.unpack_thumb();
-
-		if (ret != LIBRAW_SUCCESS)
+		const libraw_thumbnail_item_t& t = list.thumblist[i];
+		if (t.tformat == LIBRAW_INTERNAL_THUMBNAIL_JPEG && t.tlength == raw.imgdata.thumbnail.tlength)
 		{
-			throw std::runtime_error(Formatter() << "LibRaw: failed to run unpack_thumb: " << libraw_strerror(ret));
+			return i;
 		}
+	}
+
+	return -1;
+}
 
-		libraw_processed_image_t* const thumb = raw.dcraw_make_mem_thumb(&ret);
-		if (!thumb)
+// the smallest JPEG preview still providing desiredResolution for roiRect, which is relative to imageSize
+static int smallestSufficientPreviewIndex(const LibRaw& raw, int defaultIndex, QSize imageSize, QSize desiredResolution, QRect roiRect)
+{
+	const libraw_thumbnail_list_t& list = raw.imgdata.thumbs_list;
+	const libraw_thumbnail_item_t& def = list.thumblist[defaultIndex];
+
+	const QRect full(QPoint(0, 0), imageSize);
+	roiRect = roiRect.isValid() ? roiRect.intersected(full) : full;
+	if (roiRect.isEmpty() || desiredResolution.isEmpty() || def.theight == 0)
+	{
+		return defaultIndex;
+	}
+
+	// the fraction of the image's resolution which is needed, libraw's headers break std::min on Windows
+	const double sx = desiredResolution.width() * 1.0 / roiRect.width();
+	const double sy = desiredResolution.height() * 1.0 / roiRect.height();
+	const double scale = sx < sy ? sx : sy;
+	const double aspect = def.twidth * 1.0 / def.theight;
+
+	int best = defaultIndex;
+	for (int i = 0; i < list.thumbcount; i++)
+	{
+		const libraw_thumbnail_item_t& t = list.thumblist[i];
+		if (t.tformat != LIBRAW_INTERNAL_THUMBNAIL_JPEG || t.theight == 0 || t.twidth >= list.thumblist[best].twidth)
 		{
-			throw std::runtime_error(Formatter() << "LibRaw: failed to run dcraw_make_mem_thumb: " << libraw_strerror(ret));
+			continue;
 		}
 
-		if (thumb->type == LIBRAW_IMAGE_JPEG)
+		// previews of another aspect ratio are cropped and cannot be mapped onto the image
+		if (std::abs(t.twidth * 1.0 / t.theight - aspect) > 0.01 * aspect)
 		{
-			imgData = QByteArray((const char*)thumb->data, (int)thumb->data_size);
+			continue;
 		}
-		else
+
+		if (t.twidth >= scale * imageSize.width() && t.theight >= scale * imageSize.height())
 		{
-			raw.dcraw_clear_mem(thumb);
-			throw std::runtime_error("LibRaw returned a non-JPEG thumbnail, which is currently not supported, sry.");
+			best = i;
 		}
+	}
+
+	return best;
+}
+
+// references the given preview within fileBuf, if it's stored as complete JPEG stream
+static bool referenceEmbeddedPreview(QByteArray& imgData, const libraw_thumbnail_item_t& t, const void* fileBuf, qint64 buflen)
+{
+	const unsigned char* start = static_cast<const unsigned char*>(fileBuf) + t.toffset;
+	// some vendors store previews which need to be fixed up by LibRaw
+	if (t.toffset < 0 || t.tlength < 2 || t.toffset + static_cast<qint64>(t.tlength) > buflen || start[0] != 0xFF || start[1] != 0xD8)
+	{
+		return false;
+	}
+
+	imgData = QByteArray::fromRawData(reinterpret_cast<const char*>(start), static_cast<qsizetype>(t.tlength));
+	return true;
+}
+#endif
+
+// lets LibRaw extract the preview with the given index of the thumbnail list, or its default preview if index is negative
+static void loadEmbeddedPreview(QByteArray& imgData, LibRaw& raw, int index)
+{
+#if LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0, 21)
+	int ret = index < 0 ? raw.unpack_thumb() : raw.unpack_thumb_ex(index);
+#else
+	Q_UNUSED(index);
+	int ret = raw.unpack_thumb();
+#endif
+
+	if (ret != LIBRAW_SUCCESS)
+	{
+		throw std::runtime_error(Formatter() << "LibRaw: failed to run unpack_thumb: " << libraw_strerror(ret));
+	}
+
+	libraw_processed_image_t* const thumb = raw.dcraw_make_mem_thumb(&ret);
+	if (!thumb)
+	{
+		throw std::runtime_error(Formatter() << "LibRaw: failed to run dcraw_make_mem_thumb: " << libraw_strerror(ret));
+	}
 
+	if (thumb->type == LIBRAW_IMAGE_JPEG)
+	{
+		imgData = QByteArray((const char*)thumb->data, (int)thumb->data_size);
+	}
+	else
+	{
 		raw.dcraw_clear_mem(thumb);
-		raw.recycle();
+		throw std::runtime_error("LibRaw returned a non-JPEG thumbnail, which is currently not supported, sry.");
+	}
+
+	raw.dcraw_clear_mem(thumb);
+	raw.recycle();
+
+	if (imgData.isEmpty())
+	{
+		throw std::runtime_error(Formatter() << "JPEG thumb from LibRaw is empty!");
+	}
+}
+
+QSize LibRawHelper::extractThumbnail(QByteArray& encodedThumbnailOut, const void* fileBuf, qint64 buflen, QSize desiredResolution, QRect roiRect)
+{
+	LibRaw raw;
+            
+	int ret = raw.open_buffer(const_cast<void*>(fileBuf), buflen);
+	if (ret != LIBRAW_SUCCESS)
+	{
+		throw std::runtime_error(Formatter () << "LibRaw: failed to run open_buffer: " << libraw_strerror(ret));
+	}
 
-		if (imgData.isEmpty())
+	QSize imageSize;
+	int index = -1;
+
+	if (isDemosaicEnabled() && raw.imgdata.sizes.width > 0 && raw.imgdata.sizes.height > 0)
+	{
+		// the image has the resolution of the RAW data rather than the one of the preview, as it'll be replaced by the demosaiced data
+		imageSize = QSize(raw.imgdata.sizes.width, raw.imgdata.sizes.height);
+	}
+
+#if LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0, 21)
+	const int defaultIndex = defaultPreviewIndex(raw);
+	if (defaultIndex >= 0)
+	{
+		const libraw_thumbnail_item_t& def = raw.imgdata.thumbs_list.thumblist[defaultIndex];
+		const QSize fullSize = imageSize.isValid() ? imageSize : QSize(def.twidth, def.theight);
+
+		index = desiredResolution.isValid() ? smallestSufficientPreviewIndex(raw, defaultIndex, fullSize, desiredResolution, roiRect) : defaultIndex;
+
+		if (index != defaultIndex)
+		{
+			imageSize = fullSize;
+		}
+
+		if (referenceEmbeddedPreview(encodedThumbnailOut, raw.imgdata.thumbs_list.thumblist[index], fileBuf, buflen))
 		{
-			throw std::runtime_error(Formatter() << "JPEG thumb from LibRaw is empty!");
+			return imageSize;
 		}
-	};
+	}
+#else
+	Q_UNUSED(desiredResolution);
+	Q_UNUSED(roiRect);
+#endif
+
+	loadEmbeddedPreview(encodedThumbnailOut, raw, index);
+	return imageSize;
+}
 
-	loadEmbeddedPreview(encodedThumbnailOut, raw);
+bool LibRawHelper::isDemosaicEnabled()
+{
+	return demosaicEnabled;
+}
+
+void LibRawHelper::setDemosaicEnabled(bool enabled)
+{
+	demosaicEnabled = enabled;
 }
 
 const QStringList& LibRawHelper::rawFilesList()
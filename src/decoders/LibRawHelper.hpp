@@ -2,6 +2,8 @@
 #pragma once
 
 #include <QByteArray>
+#include <QRect>
+#include <QSize>
 #include <QStringList>
 
 class LibRawHelper
@@ -10,7 +12,18 @@ public:
     LibRawHelper() = delete;
 	
     static const QStringList& rawFilesList();
-    static void extractThumbnail(QByteArray& encodedThumbnailOut, const void* fileBuf, qint64 buflen);
+
+    // whether the RAW data is demosaiced when the embedded previews don't provide the requested resolution, thread-safe
+    static bool isDemosaicEnabled();
+    static void setDemosaicEnabled(bool enabled);
+
+    // Provides the smallest embedded JPEG preview of the RAW file in fileBuf which still covers desiredResolution for roiRect, or the default (usually largest)
+    // preview if desiredResolution is invalid. If the preview is stored as-is, encodedThumbnailOut merely references the corresponding bytes of fileBuf
+    // without copying them, i.e. it must not outlive fileBuf. Otherwise it receives a copy extracted by LibRaw.
+    // Returns the resolution of the image if it differs from the one of the preview provided, i.e. the size of the default preview if a smaller one
+    // has been chosen, or the size of the RAW data if demosaicing is enabled. An invalid size otherwise.
+    // roiRect is relative to that resolution.
+    static QSize extractThumbnail(QByteArray& encodedThumbnailOut, const void* fileBuf, qint64 buflen, QSize desiredResolution = QSize(), QRect roiRect = QRect());
 
     static bool isRaw(const QString& extension);
     static bool isRaw(const std::string& extension);
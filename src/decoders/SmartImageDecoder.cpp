@@ -8,6 +8,7 @@
 #include "Image.hpp"
 #include "ANPV.hpp"
 #include "LibRawHelper.hpp"
+#include "PyramidSidecar.hpp"
 
 #include <QtDebug>
 #include <QPromise>
@@ -15,6 +16,7 @@
 #include <chrono>
 #include <atomic>
 #include <mutex>
+#include <utility>
 
 struct SmartImageDecoder::Impl
 {
@@ -31,6 +33,9 @@ struct SmartImageDecoder::Impl
     QSize desiredResolution;
     // the ROI requested by decodeAsync() (not the final ROI reached!)
     QRect roiRect;
+    // the resolution and ROI decode() needs the embedded preview of RAWs for, invalid if the largest preview is needed
+    QSize rawPreviewResolution;
+    QRect rawPreviewRoi;
     QString decodingMessage;
     int decodingProgress = 0;
 
@@ -40,6 +45,9 @@ struct SmartImageDecoder::Impl
     // the ROI actually decoded in the same coordinate system as the decoded image
     QRect decodedRoiRect;
 
+    // the entirely decoded image, which a pyramid sidecar is generated from once the decoding result has been published
+    QImage sidecarSource;
+
     // May or may not contain (a part of) the encoded input file
     // It does for embedded JPEG preview in CR2
     QByteArray encodedInputFile;
@@ -49,6 +57,9 @@ struct SmartImageDecoder::Impl
     QScopedPointer<QFile> file;
     qint64 encodedInputBufferSize = 0;
     const unsigned char *encodedInputBufferPtr = nullptr;
+    // the memory-mapped input file, which differs from the encoded input buffer for RAWs
+    qint64 fileMappedSize = 0;
+    const unsigned char *fileMapped = nullptr;
 
     Impl(SmartImageDecoder *q) : q(q)
     {}
@@ -164,6 +175,12 @@ void SmartImageDecoder::cancelCallback()
     }
 }
 
+// The entire input file, which is only valid between init() and close(). The returned array references the mapped memory without copying it.
+QByteArray SmartImageDecoder::mappedFile() const
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(d->fileMapped), d->fileMappedSize);
+}
+
 void SmartImageDecoder::open()
 {
     try
@@ -194,8 +211,9 @@ void SmartImageDecoder::init()
         qint64 mapSize = d->file->size();
         const unsigned char *fileMapped = d->file->map(0, mapSize, QFileDevice::NoOptions);
 
-        d->encodedInputBufferSize = mapSize;
-        d->encodedInputBufferPtr = fileMapped;
+        d->encodedInputBufferSize = d->fileMappedSize = mapSize;
+        d->encodedInputBufferPtr = d->fileMapped = fileMapped;
+        QSize rawImageSize;
 
         if(!this->image()->isRaw())
         {
@@ -206,7 +224,8 @@ void SmartImageDecoder::init()
         }
         else
         {
-            LibRawHelper::extractThumbnail(d->encodedInputFile, fileMapped, mapSize);
+            // usually references the preview within fileMapped, hence encodedInputFile must be cleared before the file is unmapped
+            rawImageSize = LibRawHelper::extractThumbnail(d->encodedInputFile, fileMapped, mapSize, d->rawPreviewResolution, d->rawPreviewRoi);
 
             d->encodedInputBufferPtr = reinterpret_cast<const unsigned char *>(d->encodedInputFile.constData());
             d->encodedInputBufferSize = d->encodedInputFile.size();
@@ -216,9 +235,15 @@ void SmartImageDecoder::init()
 
         this->decodeHeader(d->encodedInputBufferPtr, d->encodedInputBufferSize);
 
+        if(rawImageSize.isValid())
+        {
+            // the embedded preview being decoded has a lower resolution than the image, see LibRawHelper::extractThumbnail()
+            this->image()->setSize(rawImageSize);
+        }
+
         QSharedPointer<ExifWrapper> exifWrapper(new ExifWrapper());
         // intentionally use the original file to read EXIF data, as this may not be available in d->encodedInputBuffer
-        exifWrapper->loadFromData(QByteArray::fromRawData(reinterpret_cast<const char *>(fileMapped), mapSize));
+        exifWrapper->loadMetadataSegments(fileMapped, mapSize);
         this->image()->setExif(exifWrapper);
 
         QImage thumb = this->image()->thumbnail();
@@ -319,7 +344,7 @@ QFuture<DecodingState> SmartImageDecoder::decodeAsync(DecodingState targetState,
 
 void SmartImageDecoder::run()
 {
-    std::lock_guard g(d->asyncApiMtx);
+    std::unique_lock g(d->asyncApiMtx);
     d->promise->start();
 
     // reference the currently decoded image to prevent it from being deleted while decoding is still ongoing (#43)
@@ -367,6 +392,18 @@ void SmartImageDecoder::run()
     }
 
     d->promise->finish();
+
+    QImage sidecarSource = std::exchange(d->sidecarSource, QImage());
+    QFileInfo sidecarFile = refImg.isNull() ? QFileInfo() : refImg->fileInfo();
+    refImg.reset();
+    g.unlock();
+
+    // From here on, we might have been destroyed already.
+    if(!sidecarSource.isNull())
+    {
+        // the Image still holds the decoded image while being displayed, so the full resolution image is not kept alive by this
+        PyramidSidecar::generateAsync(sidecarFile, sidecarSource);
+    }
 }
 
 void SmartImageDecoder::decode(DecodingState targetState, QSize desiredResolution, QRect roiRect)
@@ -377,11 +414,27 @@ void SmartImageDecoder::decode(DecodingState targetState, QSize desiredResolutio
 
         do
         {
+            // thumbnails and previews may be decoded from a smaller embedded preview of RAWs
+            bool smallerRawPreviewSuffices = targetState == DecodingState::PreviewImage && desiredResolution.isValid();
+            d->rawPreviewResolution = smallerRawPreviewSuffices ? desiredResolution : QSize();
+            d->rawPreviewRoi = roiRect;
+
             this->init();
 
             if(targetState == DecodingState::PreviewImage || targetState == DecodingState::FullImage)
             {
-                QImage decodedImg = this->decodingLoop(desiredResolution, roiRect);
+                QImage decodedImg = this->decodeFromSidecar(desiredResolution, roiRect);
+
+                if(decodedImg.isNull())
+                {
+                    decodedImg = this->decodingLoop(desiredResolution, roiRect);
+
+                    if(d->decodingState() == DecodingState::FullImage)
+                    {
+                        // deferred to run(), to not delay whoever is waiting for the decoded image
+                        d->sidecarSource = decodedImg;
+                    }
+                }
 
                 // if this assert fails, either an unintended QImage::copy() happened, or an intended QImage::copy() happend but a call to this->image()->setDecodedImage() is missing,
                 // or multiple decoders are concurrently decoding the same image.
@@ -420,6 +473,72 @@ void SmartImageDecoder::decode(DecodingState targetState, QSize desiredResolutio
     }
 }
 
+// Decodes from the pyramid sidecar, if there is one providing a level of sufficient resolution. Returns a null image otherwise.
+QImage SmartImageDecoder::decodeFromSidecar(QSize desiredResolution, QRect roiRect)
+{
+    if(!PyramidSidecar::isEnabled() || !desiredResolution.isValid() || desiredResolution.isEmpty())
+    {
+        return QImage();
+    }
+
+    const QRect fullResRect = this->image()->fullResolutionRect();
+    QRect targetImageRect = roiRect.isEmpty() ? fullResRect : roiRect.intersected(fullResRect);
+
+    if(targetImageRect.isEmpty() || static_cast<qint64>(fullResRect.width()) * fullResRect.height() < PyramidSidecar::MinPixels)
+    {
+        return QImage();
+    }
+
+    PyramidSidecar sidecar(PyramidSidecar::pathFor(this->image()->fileInfo()));
+
+    if(!sidecar.isValid() || sidecar.levelSize(1) != QSize((fullResRect.width() + 1) / 2, (fullResRect.height() + 1) / 2))
+    {
+        return QImage();
+    }
+
+    // the coarsest level still providing the desired resolution
+    double scale = std::min(targetImageRect.width() * 1.0 / desiredResolution.width(), targetImageRect.height() * 1.0 / desiredResolution.height());
+    int level = 0;
+
+    while(level < sidecar.levels() && (2 << level) <= scale)
+    {
+        level++;
+    }
+
+    if(level == 0)
+    {
+        // full resolution required
+        return QImage();
+    }
+
+    QSize pageSize = sidecar.levelSize(level);
+    QTransform scaleTrafo = this->fullResToPageTransform(pageSize.width(), pageSize.height());
+    QRect mappedRoi = scaleTrafo.mapRect(targetImageRect).intersected(QRect(QPoint(0, 0), pageSize));
+
+    this->setDecodingMessage((Formatter() << "Decoding level " << level << " of pyramid sidecar").str().c_str());
+
+    QImage image = this->allocateImageBuffer(mappedRoi.size(), QImage::Format_RGBA8888);
+    image.setOffset(targetImageRect.topLeft());
+    this->image()->setDecodedImage(image, scaleTrafo.inverted());
+
+    // write through constBits() to not detach from the image just published
+    uchar *buf = const_cast<uchar *>(image.constBits());
+    bool ok = sidecar.read(level, mappedRoi, buf, image.bytesPerLine(), [&](const QRect & rows)
+    {
+        this->cancelCallback();
+        this->updateDecodedRoiRect(rows);
+    });
+
+    if(!ok)
+    {
+        throw std::runtime_error(Formatter() << "Failed to read pyramid sidecar of " << this->image()->fileInfo().fileName().toStdString());
+    }
+
+    this->setDecodingProgress(100);
+    this->setDecodingState(DecodingState::PreviewImage);
+    return image;
+}
+
 void SmartImageDecoder::convertColorSpace(QImage &image, bool silent, QTransform currentPageToFullResTransform)
 {
     auto depth = image.depth();
@@ -479,6 +598,8 @@ void SmartImageDecoder::close()
     d->encodedInputBufferSize = 0;
     d->encodedInputBufferPtr = nullptr;
     d->encodedInputFile.clear();
+    d->fileMappedSize = 0;
+    d->fileMapped = nullptr;
 
     if(d->file)
     {
@@ -63,6 +63,7 @@ protected:
 
     void cancelCallback();
     void assertNotDecoding();
+    QByteArray mappedFile() const;
 
     void resetDecodedRoiRect();
     void updateDecodedRoiRect(const QRect &r);
@@ -76,6 +77,8 @@ protected:
     void setDecodingProgress(int prog);
 
 private:
+    QImage decodeFromSidecar(QSize desiredResolution, QRect roiRect);
+
     struct Impl;
     std::unique_ptr<Impl> d;
 };
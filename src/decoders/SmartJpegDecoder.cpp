@@ -4,6 +4,7 @@
 #include "Image.hpp"
 
 #include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <QDebug>
 #include <QColorSpace>
@@ -216,8 +217,11 @@ QImage SmartJpegDecoder::decodingLoop(QSize desiredResolution, QRect roiRect)
     cinfo.enable_2pass_quant = false;
     cinfo.do_block_smoothing = false;
 
+    // the JPEG may be an embedded preview of lower resolution than the image itself, e.g. for RAWs
+    QRect roiOfJpeg = this->fullResToPageTransform(cinfo.image_width, cinfo.image_height).mapRect(roiRect);
+
     cinfo.scale_num = desiredResolution.width();
-    cinfo.scale_denom = roiRect.width();
+    cinfo.scale_denom = std::max(1, roiOfJpeg.width());
 
     double scale = cinfo.scale_num * 1.0 / cinfo.scale_denom;
 
@@ -346,7 +350,8 @@ QImage SmartJpegDecoder::decodingLoop(QSize desiredResolution, QRect roiRect)
     d->progMgr.completed_passes = d->progMgr.total_passes;
     d->progMgr.progress_monitor((j_common_ptr)&cinfo);
 
-    if(scale == 1 && xoffset == 0 && croppedWidth == cinfo.image_width && skippedScanlinesTop == 0 && lastScanlineToDecode == cinfo.image_height)
+    if(scale == 1 && xoffset == 0 && croppedWidth == cinfo.image_width && skippedScanlinesTop == 0 && lastScanlineToDecode == cinfo.image_height
+            && QSize(cinfo.image_width, cinfo.image_height) == this->image()->size())
     {
         this->setDecodingState(DecodingState::FullImage);
     }
@@ -0,0 +1,175 @@
+
+#include "SmartRawDecoder.hpp"
+#include "LibRawHelper.hpp"
+#include "UserCancellation.hpp"
+#include "Formatter.hpp"
+#include "Image.hpp"
+
+#include <QTransform>
+#include <QtGlobal>
+#include <memory>
+#include <stdexcept>
+
+// libraw basically include the entire Windoof API, messing up any C++ source code that uses std::min
+#include <libraw.h>
+
+SmartRawDecoder::SmartRawDecoder(QSharedPointer<Image> image) : SmartJpegDecoder(image)
+{
+}
+
+SmartRawDecoder::~SmartRawDecoder() = default;
+
+QImage SmartRawDecoder::decodingLoop(QSize desiredResolution, QRect roiRect)
+{
+    // show the embedded preview first, it's decoded in a fraction of the time needed for demosaicing
+    QImage preview = SmartJpegDecoder::decodingLoop(desiredResolution, roiRect);
+
+    if(!LibRawHelper::isDemosaicEnabled() || this->image()->decodingState() == DecodingState::FullImage)
+    {
+        return preview;
+    }
+
+    if(!roiRect.isValid())
+    {
+        roiRect = this->image()->fullResolutionRect();
+    }
+
+    // like the JPEG decoder, only consider the width and never upscale
+    const int desiredWidth = desiredResolution.isValid() ? qMin(desiredResolution.width(), roiRect.width()) : roiRect.width();
+
+    if(preview.width() >= desiredWidth)
+    {
+        return preview;
+    }
+
+    // a half-sized demosaic is several times faster and suffices when zoomed out
+    return this->demosaic(desiredWidth * 2 <= roiRect.width(), roiRect);
+}
+
+QImage SmartRawDecoder::demosaic(bool halfSize, QRect roiRect)
+{
+    // LibRaw is huge, don't put it on the stack
+    auto raw = std::make_unique<LibRaw>();
+
+    libraw_output_params_t &params = raw->imgdata.params;
+    params.half_size = halfSize;
+    // the orientation is applied when displaying the image, just as for the embedded preview
+    params.user_flip = 0;
+    params.use_camera_wb = 1;
+    // sRGB, so that no further colorspace conversion is needed
+    params.output_color = 1;
+    params.output_bps = 8;
+
+    raw->set_progress_handler([](void *data, enum LibRaw_progress stage, int, int) -> int
+    {
+        auto *self = static_cast<SmartRawDecoder *>(data);
+
+        try
+        {
+            self->cancelCallback();
+        }
+        catch(const UserCancellation &)
+        {
+            // never throw through LibRaw, ask it to stop instead
+            return 1;
+        }
+
+        self->setDecodingMessage(QStringLiteral("Demosaicing RAW data: ") + QString::fromLatin1(libraw_strprogress(stage)));
+        return 0;
+    }, this);
+
+    this->setDecodingMessage("Reading RAW data");
+
+    QByteArray file = this->mappedFile();
+    int ret = raw->open_buffer(const_cast<char *>(file.constData()), file.size());
+
+    if(ret != LIBRAW_SUCCESS)
+    {
+        throw std::runtime_error(Formatter() << "LibRaw: failed to run open_buffer: " << libraw_strerror(ret));
+    }
+
+    ret = raw->unpack();
+    this->cancelCallback();
+
+    if(ret != LIBRAW_SUCCESS)
+    {
+        throw std::runtime_error(Formatter() << "LibRaw: failed to run unpack: " << libraw_strerror(ret));
+    }
+
+    ret = raw->dcraw_process();
+    this->cancelCallback();
+
+    if(ret != LIBRAW_SUCCESS)
+    {
+        throw std::runtime_error(Formatter() << "LibRaw: failed to run dcraw_process: " << libraw_strerror(ret));
+    }
+
+    std::unique_ptr<libraw_processed_image_t, decltype(&LibRaw::dcraw_clear_mem)> processed(raw->dcraw_make_mem_image(&ret), &LibRaw::dcraw_clear_mem);
+
+    if(!processed)
+    {
+        throw std::runtime_error(Formatter() << "LibRaw: failed to run dcraw_make_mem_image: " << libraw_strerror(ret));
+    }
+
+    if(processed->type != LIBRAW_IMAGE_BITMAP || processed->colors != 3 || processed->bits != 8)
+    {
+        throw std::runtime_error(Formatter() << "LibRaw returned an unsupported image with " << processed->colors << " colors and " << processed->bits << " bits");
+    }
+
+    // only the processed image is needed from here on
+    raw->recycle();
+    this->cancelCallback();
+
+    QTransform fullResToRaw = this->fullResToPageTransform(processed->width, processed->height);
+    QRect rawRoi = fullResToRaw.mapRect(roiRect).intersected(QRect(0, 0, processed->width, processed->height));
+
+    if(rawRoi.isEmpty())
+    {
+        throw std::runtime_error("The region of interest is outside of the demosaiced RAW data");
+    }
+
+    QImage image = this->allocateImageBuffer(rawRoi.width(), rawRoi.height(), QImage::Format_RGBX8888);
+    auto *dataPtrBackup = image.constBits();
+
+    this->setDecodingMessage("Copying demosaiced RAW data");
+
+    const size_t srcStride = static_cast<size_t>(processed->width) * 3;
+
+    for(int y = 0; y < rawRoi.height(); y++)
+    {
+        const uchar *in = processed->data + (rawRoi.top() + y) * srcStride + static_cast<size_t>(rawRoi.left()) * 3;
+        uchar *out = const_cast<uchar *>(image.constScanLine(y));
+
+        for(int x = 0; x < rawRoi.width(); x++)
+        {
+            out[x * 4 + 0] = in[x * 3 + 0];
+            out[x * 4 + 1] = in[x * 3 + 1];
+            out[x * 4 + 2] = in[x * 3 + 2];
+            out[x * 4 + 3] = 0xFF;
+        }
+    }
+
+    processed.reset();
+
+    // replace the preview only now that the buffer is completely filled, so that it never shows up blank
+    QTransform rawToFullRes = fullResToRaw.inverted();
+    image.setOffset(rawToFullRes.mapRect(rawRoi).topLeft());
+
+    this->resetDecodedRoiRect();
+    this->image()->setDecodedImage(image, rawToFullRes);
+    this->updateDecodedRoiRect(image.rect());
+
+    this->setDecodingMessage("RAW demosaicing completed successfully.");
+
+    if(!halfSize && image.size() == this->image()->size())
+    {
+        this->setDecodingState(DecodingState::FullImage);
+    }
+    else
+    {
+        this->setDecodingState(DecodingState::PreviewImage);
+    }
+
+    Q_ASSERT(image.constBits() == dataPtrBackup);
+    return image;
+}
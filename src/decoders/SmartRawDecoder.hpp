@@ -0,0 +1,25 @@
+
+#pragma once
+
+#include "DecodingState.hpp"
+#include "SmartJpegDecoder.hpp"
+
+/**
+ * Decodes RAWs from their embedded JPEG preview. If demosaicing is enabled (see LibRawHelper::isDemosaicEnabled()) and the preview doesn't provide
+ * the requested resolution, the RAW data is demosaiced by LibRaw afterwards, replacing the preview once it's ready.
+ */
+class SmartRawDecoder : public SmartJpegDecoder
+{
+public:
+    SmartRawDecoder(QSharedPointer<Image> image);
+    ~SmartRawDecoder() override;
+
+    SmartRawDecoder(const SmartRawDecoder &) = delete;
+    SmartRawDecoder &operator=(const SmartRawDecoder &) = delete;
+
+protected:
+    QImage decodingLoop(QSize desiredResolution, QRect roiRect) override;
+
+private:
+    QImage demosaic(bool halfSize, QRect roiRect);
+};
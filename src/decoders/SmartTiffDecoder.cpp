@@ -3,8 +3,11 @@
 #include "Formatter.hpp"
 #include "Image.hpp"
 #include "ANPV.hpp"
+#include "BoxDecimator.hpp"
 
 #include <cstring>
+#include <optional>
+#include <algorithm>
 #include <QDebug>
 #include <QColorSpace>
 
@@ -437,7 +440,11 @@ QImage SmartTiffDecoder::decodingLoop(QSize desiredResolution, QRect roiRect)
     QTransform scaleTrafo = this->fullResToPageTransform(d->pageInfos[imagePageToDecode].width, d->pageInfos[imagePageToDecode].height);
     QRect mappedRoi = scaleTrafo.mapRect(targetImageRect);
 
-    QImage image = this->allocateImageBuffer(mappedRoi.size(), d->format(imagePageToDecode));
+    // If there is no page of suitable resolution, e.g. for single page TIFFs, decimate while decoding rather than allocating the full resolution.
+    double pageToDesired = std::min(mappedRoi.width() * 1.0 / std::max(1, desiredDecodeResolution.width()), mappedRoi.height() * 1.0 / std::max(1, desiredDecodeResolution.height()));
+    int decimation = std::clamp(static_cast<int>(pageToDesired), 1, BoxDecimator::MaxFactor);
+
+    QImage image = this->allocateImageBuffer(BoxDecimator::decimatedSize(mappedRoi.size(), decimation), d->format(imagePageToDecode));
 
     // RESOLUTIONUNIT must be read and set now (and not in decodeInternal), because QImage::setDotsPerMeterXY() calls detach() and therefore copies the entire image!!!
     float resX = 0;
@@ -473,10 +480,10 @@ QImage SmartTiffDecoder::decodingLoop(QSize desiredResolution, QRect roiRect)
 
     image.setOffset(roiRect.topLeft());
 
-    QTransform toFullScaleTransform = scaleTrafo.inverted();
+    QTransform toFullScaleTransform = QTransform::fromScale(decimation, decimation) * scaleTrafo.inverted();
     this->image()->setDecodedImage(image, toFullScaleTransform);
     d->debugTiffLayout.clear();
-    this->decodeInternal(imagePageToDecode, image, mappedRoi, toFullScaleTransform, desiredResolution, false);
+    this->decodeInternal(imagePageToDecode, image, mappedRoi, scaleTrafo.inverted(), desiredResolution, false, decimation);
     this->convertColorSpace(image, false, toFullScaleTransform);
 
     bool fullImageDecoded = (imagePageToDecode == d->findHighestResolution(d->pageInfos)); // We have decoded the highest resolution available
@@ -495,7 +502,7 @@ QImage SmartTiffDecoder::decodingLoop(QSize desiredResolution, QRect roiRect)
     return image;
 }
 
-void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRect roi, QTransform currentPageToFullResTransform, QSize desiredResolution, bool quiet)
+void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRect roi, QTransform currentPageToFullResTransform, QSize desiredResolution, bool quiet, int decimation)
 {
     const auto &width = d->pageInfos[imagePageToDecode].width;
     const auto &height = d->pageInfos[imagePageToDecode].height;
@@ -506,7 +513,7 @@ void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRec
         roi = QRect(0, 0, width, height);
     }
 
-    Q_ASSERT(roi.size() == image.size());
+    Q_ASSERT(BoxDecimator::decimatedSize(roi.size(), decimation) == image.size());
 
     TIFFSetDirectory(d->tiff, imagePageToDecode);
 
@@ -531,6 +538,14 @@ void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRec
     auto *dataPtrBackup = image.constBits();
     uint32_t *buf = const_cast<uint32_t *>(reinterpret_cast<const uint32_t *>(dataPtrBackup));
 
+    // averages the decoded pixels of roi into the smaller image, in which case buf is only written once blocks of rows are complete
+    std::optional<BoxDecimator> decimator;
+
+    if(decimation > 1)
+    {
+        decimator.emplace(roi.width(), roi.height(), decimation, buf, image.bytesPerLine() / sizeof(uint32_t));
+    }
+
     if(TIFFIsTiled(d->tiff))
     {
         uint32_t tw, tl;
@@ -541,6 +556,7 @@ void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRec
         }
 
         std::vector<uint32_t> tileBuf(tw * tl);
+        std::vector<uint32_t> rowBuf(decimator ? tw : 0);
 
         unsigned destRowIncr = 0;
 
@@ -580,13 +596,22 @@ void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRec
                         unsigned srcRow = tl - 1 - (i + linesToSkipFromTop);
                         // the source column to read from, if a tile intersects to the left of areaToCopy, we need to skip widthToSkip pixels, if a tile intersects at the right, we start with with the first pixel
                         unsigned srcCol = widthToSkipFromLeft;
-                        d->convert32BitOrder(&buf[dr * image.width() + destCol], &tileBuf[srcRow * tw + srcCol], 1, areaToCopy.width());
+
+                        if(decimator)
+                        {
+                            d->convert32BitOrder(rowBuf.data(), &tileBuf[srcRow * tw + srcCol], 1, areaToCopy.width());
+                            decimator->addPixels(areaToCopy.x() - roi.x(), areaToCopy.y() - roi.y() + i, rowBuf.data(), areaToCopy.width());
+                        }
+                        else
+                        {
+                            d->convert32BitOrder(&buf[dr * image.width() + destCol], &tileBuf[srcRow * tw + srcCol], 1, areaToCopy.width());
+                        }
                     }
 
                     destCol += areaToCopy.width();
                     destRowIncr = areaToCopy.height();
 
-                    if(!quiet)
+                    if(!quiet && !decimator)
                     {
                         this->updateDecodedRoiRect(areaToCopy);
 
@@ -595,6 +620,17 @@ void SmartTiffDecoder::decodeInternal(int imagePageToDecode, QImage &image, QRec
                     }
                 }
             }
+
+            if(decimator)
+            {
+                QRect written = decimator->flush(static_cast<int>(std::min(y + tl, height)) - roi.y());
+
+                if(!quiet && !written.isEmpty())
+                {
+                    this->updateDecodedRoiRect(written);
+                    this->setDecodingProgress(y * 100.0 / height);
+                }
+            }
         }
 
         Q_ASSERT(image.constBits() == dataPtrBackup);
@@ -698,12 +734,23 @@ gehtnich:
 
                     for(unsigned i = 0; i < (unsigned)areaToCopy.height(); i++)
                     {
-                        ::memcpy(&buf[size_t(destRow++) * image.width() + 0], &stripBufUncrustified.data()[(i + linesToSkipFromTop) * width + areaToCopy.x()], areaToCopy.width() * sizeof(uint32_t));
+                        const uint32_t *src = &stripBufUncrustified.data()[(i + linesToSkipFromTop) * width + areaToCopy.x()];
+
+                        if(decimator)
+                        {
+                            decimator->addPixels(0, areaToCopy.y() - roi.y() + i, src, areaToCopy.width());
+                        }
+                        else
+                        {
+                            ::memcpy(&buf[size_t(destRow++) * image.width() + 0], src, areaToCopy.width() * sizeof(uint32_t));
+                        }
                     }
 
-                    if(!quiet)
+                    QRect written = decimator ? decimator->flush(areaToCopy.bottom() + 1 - roi.y()) : areaToCopy;
+
+                    if(!quiet && !written.isEmpty())
                     {
-                        this->updateDecodedRoiRect(areaToCopy);
+                        this->updateDecodedRoiRect(written);
 
                         double progress = strip * 100.0 / stripCount;
                         this->setDecodingProgress(progress);
@@ -715,6 +762,17 @@ gehtnich:
         }
     }
 
+    if(decimator)
+    {
+        // the last rows in case the decoding of the roi ended within a block
+        QRect written = decimator->flush(roi.height());
+
+        if(!quiet && !written.isEmpty())
+        {
+            this->updateDecodedRoiRect(written);
+        }
+    }
+
     this->setDecodingMessage("TIFF decoding completed successfully.");
     this->setDecodingProgress(100);
 }
@@ -24,5 +24,5 @@ protected:
 private:
     struct Impl;
     std::unique_ptr<Impl> d;
-    void decodeInternal(int imagePageToDecode, QImage &image, QRect roi, QTransform, QSize desiredResolution, bool quiet);
+    void decodeInternal(int imagePageToDecode, QImage &image, QRect roi, QTransform, QSize desiredResolution, bool quiet, int decimation = 1);
 };
@@ -30,6 +30,8 @@
 #include "Formatter.hpp"
 #include "SortedImageModel.hpp"
 #include "SmartImageDecoder.hpp"
+#include "PyramidSidecar.hpp"
+#include "LibRawHelper.hpp"
 #include "HardLinkFileCommand.hpp"
 #include "MoveFileCommand.hpp"
 #include "DeleteFileCommand.hpp"
@@ -334,6 +336,9 @@ struct ANPV::Impl
         settings.setValue("imageSortField", static_cast<int>(q->imageSortField()));
         settings.setValue("sectionSortField", static_cast<int>(q->sectionSortField()));
         settings.setValue("iconHeight", q->iconHeight());
+        settings.setValue("generatePyramidSidecars", PyramidSidecar::isEnabled());
+        settings.setValue("pyramidSidecarCacheMiB", PyramidSidecar::cacheLimit() / (1024 * 1024));
+        settings.setValue("demosaicRawImages", LibRawHelper::isDemosaicEnabled());
 
         QByteArray actionsArray;
         {
@@ -364,6 +369,11 @@ struct ANPV::Impl
         q->setImageSortField(static_cast<SortField>(settings.value("imageSortField", static_cast<int>(SortField::FileName)).toInt()));
         q->setSectionSortField(static_cast<SortField>(settings.value("sectionSortField", static_cast<int>(SortField::None)).toInt()));
         q->setIconHeight(settings.value("iconHeight", 150).toInt());
+        // opt-in, as sidecars may occupy a lot of disk space
+        PyramidSidecar::setEnabled(settings.value("generatePyramidSidecars", false).toBool());
+        PyramidSidecar::setCacheLimit(settings.value("pyramidSidecarCacheMiB", PyramidSidecar::DefaultCacheLimit / (1024 * 1024)).toLongLong() * 1024 * 1024);
+        // opt-in, as demosaicing is slow and memory hungry
+        LibRawHelper::setDemosaicEnabled(settings.value("demosaicRawImages", false).toBool());
 
         QByteArray actionsArray = settings.value("actionGroupFileOperation").toByteArray();
 
@@ -0,0 +1,76 @@
+
+#include "BoxDecimator.hpp"
+
+#include <algorithm>
+
+BoxDecimator::BoxDecimator(int srcWidth, int srcHeight, int factor, uint32_t *dst, size_t dstStride)
+    : srcWidth(srcWidth), srcHeight(srcHeight), factor(std::clamp(factor, 1, MaxFactor)), dst(dst), dstStride(dstStride)
+{
+    this->dstWidth = decimatedSize(QSize(srcWidth, srcHeight), this->factor).width();
+}
+
+QSize BoxDecimator::decimatedSize(const QSize &src, int factor)
+{
+    return QSize((src.width() + factor - 1) / factor, (src.height() + factor - 1) / factor);
+}
+
+void BoxDecimator::addPixels(int x, int y, const uint32_t *pixels, int count)
+{
+    if(y < 0 || y >= this->srcHeight)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> &sums = this->pending[y / this->factor];
+
+    if(sums.empty())
+    {
+        sums.resize(static_cast<size_t>(this->dstWidth) * 4);
+    }
+
+    count = std::min(count, this->srcWidth - x);
+
+    for(int i = 0; i < count; i++)
+    {
+        const uint32_t p = pixels[i];
+        uint32_t *s = &sums[static_cast<size_t>((x + i) / this->factor) * 4];
+        s[0] += p & 0xFF;
+        s[1] += (p >> 8) & 0xFF;
+        s[2] += (p >> 16) & 0xFF;
+        s[3] += p >> 24;
+    }
+}
+
+QRect BoxDecimator::flush(int y)
+{
+    QRect written;
+
+    while(!this->pending.empty())
+    {
+        auto it = this->pending.begin();
+        const int row = it->first;
+        const int firstSrcRow = row * this->factor;
+        const int rows = std::min(this->factor, this->srcHeight - firstSrcRow);
+
+        if(firstSrcRow + rows > y)
+        {
+            break;
+        }
+
+        uint32_t *out = this->dst + static_cast<size_t>(row) * this->dstStride;
+        const std::vector<uint32_t> &sums = it->second;
+
+        for(int c = 0; c < this->dstWidth; c++)
+        {
+            // blocks at the right and bottom edge may be incomplete
+            const uint32_t n = static_cast<uint32_t>(rows) * std::min(this->factor, this->srcWidth - c * this->factor);
+            const uint32_t *s = &sums[static_cast<size_t>(c) * 4];
+            out[c] = ((s[0] + n / 2) / n) | (((s[1] + n / 2) / n) << 8) | (((s[2] + n / 2) / n) << 16) | (((s[3] + n / 2) / n) << 24);
+        }
+
+        written = written.united(QRect(0, row, this->dstWidth, 1));
+        this->pending.erase(it);
+    }
+
+    return written;
+}
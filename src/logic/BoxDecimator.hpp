@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <QRect>
+#include <QSize>
+#include <map>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Downscales 32 bit pixels by an integer factor while they are being decoded, by averaging each block of factor x factor source pixels.
+ * Source pixels may be fed in any order, e.g. strip- or tile-wise. Only the destination rows not yet completed are buffered,
+ * so that the source image never needs to be held in memory entirely.
+ */
+class BoxDecimator
+{
+public:
+    // the sums of a block must not overflow 32 bits
+    static constexpr int MaxFactor = 4096;
+
+    // dst must be large enough to hold decimatedSize() pixels, dstStride is in pixels
+    BoxDecimator(int srcWidth, int srcHeight, int factor, uint32_t *dst, size_t dstStride);
+
+    static QSize decimatedSize(const QSize &src, int factor);
+
+    // accumulates count pixels of source row y, starting at column x
+    void addPixels(int x, int y, const uint32_t *pixels, int count);
+
+    // Writes all destination rows whose source rows are all above row y, i.e. which will not receive any more pixels.
+    // Returns the rows written in destination coordinates, or an empty rect if none.
+    QRect flush(int y);
+
+private:
+    int srcWidth;
+    int srcHeight;
+    int factor;
+    uint32_t *dst;
+    size_t dstStride;
+    int dstWidth;
+
+    // the sums of each channel of the pending destination rows
+    std::map<int, std::vector<uint32_t>> pending;
+};
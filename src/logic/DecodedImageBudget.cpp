@@ -0,0 +1,180 @@
+
+#include "DecodedImageBudget.hpp"
+
+#include <QCoreApplication>
+#include <QtDebug>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <iterator>
+
+struct DecodedImageBudget::Impl
+{
+    struct Entry
+    {
+        qint64 bytes;
+        std::list<const Image *>::iterator lru;
+        // eviction has been requested already, don't keep asking until the size changes or the owner declines
+        bool requested = false;
+    };
+
+    mutable std::mutex m;
+    qint64 limit = DefaultLimitMiB * 1024 * 1024;
+    qint64 used = 0;
+
+    // least recently used images at the front
+    std::list<const Image *> lru;
+    std::unordered_map<const Image *, Entry> entries;
+
+    // collects the least recently used images to be released to get back within the limit
+    std::vector<const Image *> victims()
+    {
+        std::vector<const Image *> result;
+        qint64 remaining = this->used;
+
+        for(auto it = this->lru.begin(); it != this->lru.end() && remaining > this->limit; ++it)
+        {
+            Entry &e = this->entries.at(*it);
+
+            if(e.requested)
+            {
+                // the owner has been asked already, but may be unable to release it, e.g. because it's currently displayed
+                continue;
+            }
+
+            e.requested = true;
+            remaining -= e.bytes;
+            result.push_back(*it);
+        }
+
+        return result;
+    }
+};
+
+DecodedImageBudget::DecodedImageBudget() : d(std::make_unique<Impl>())
+{
+    // we might be created by a decoder thread, make sure signals are delivered by the event loop of the GUI thread
+    if(QCoreApplication::instance() != nullptr)
+    {
+        this->moveToThread(QCoreApplication::instance()->thread());
+    }
+}
+
+DecodedImageBudget::~DecodedImageBudget() = default;
+
+DecodedImageBudget *DecodedImageBudget::globalInstance()
+{
+    static DecodedImageBudget budget;
+    return &budget;
+}
+
+qint64 DecodedImageBudget::limit() const
+{
+    std::lock_guard<std::mutex> l(d->m);
+    return d->limit;
+}
+
+void DecodedImageBudget::setLimit(qint64 bytes)
+{
+    std::vector<const Image *> victims;
+    {
+        std::lock_guard<std::mutex> l(d->m);
+        d->limit = bytes;
+
+        for(auto &[img, e] : d->entries)
+        {
+            e.requested = false;
+        }
+
+        victims = d->victims();
+    }
+
+    this->requestEviction(victims);
+}
+
+qint64 DecodedImageBudget::usage() const
+{
+    std::lock_guard<std::mutex> l(d->m);
+    return d->used;
+}
+
+void DecodedImageBudget::update(const Image *img, qint64 bytes)
+{
+    std::vector<const Image *> victims;
+    {
+        std::lock_guard<std::mutex> l(d->m);
+        auto it = d->entries.find(img);
+
+        if(it != d->entries.end())
+        {
+            d->used -= it->second.bytes;
+            d->lru.erase(it->second.lru);
+            d->entries.erase(it);
+        }
+
+        if(bytes <= 0)
+        {
+            return;
+        }
+
+        d->used += bytes;
+        d->lru.push_back(img);
+        d->entries.emplace(img, Impl::Entry{bytes, std::prev(d->lru.end())});
+
+        victims = d->victims();
+    }
+
+    this->requestEviction(victims);
+}
+
+void DecodedImageBudget::touch(const Image *img)
+{
+    std::lock_guard<std::mutex> l(d->m);
+    auto it = d->entries.find(img);
+
+    if(it != d->entries.end())
+    {
+        d->lru.splice(d->lru.end(), d->lru, it->second.lru);
+        // it may be asked again once it has become the least recently used one
+        it->second.requested = false;
+    }
+}
+
+void DecodedImageBudget::decline(const Image *img)
+{
+    std::lock_guard<std::mutex> l(d->m);
+    auto it = d->entries.find(img);
+
+    if(it != d->entries.end())
+    {
+        it->second.requested = false;
+    }
+}
+
+void DecodedImageBudget::enforceLimit()
+{
+    std::vector<const Image *> victims;
+    {
+        std::lock_guard<std::mutex> l(d->m);
+        victims = d->victims();
+    }
+
+    this->requestEviction(victims);
+}
+
+void DecodedImageBudget::requestEviction(const std::vector<const Image *> &victims)
+{
+    if(!victims.empty())
+    {
+        qDebug() << "Decoded images occupy" << this->usage() / (1024 * 1024) << "MiB, requesting eviction of" << victims.size() << "images";
+    }
+
+    for(const Image *v : victims)
+    {
+        QMetaObject::invokeMethod(this, [this, v]()
+        {
+            emit this->evictionRequested(v);
+        }, Qt::QueuedConnection);
+    }
+}
@@ -0,0 +1,50 @@
+
+#pragma once
+
+#include <QObject>
+#include <memory>
+#include <vector>
+
+#include "Image.hpp"
+
+/**
+ * Process-wide accounting of the memory occupied by decoded images, i.e. Image::decodedImage().
+ * Images are tracked in least recently used order. Once their total size exceeds the limit, the owners of the least recently used images
+ * are asked to release them via evictionRequested(). The accounting methods are thread-safe, the signal is always emitted in the GUI thread.
+ */
+class DecodedImageBudget : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr qint64 DefaultLimitMiB = 4096;
+
+    static DecodedImageBudget *globalInstance();
+
+    ~DecodedImageBudget() override;
+
+    qint64 limit() const;
+    void setLimit(qint64 bytes);
+    qint64 usage() const;
+
+    // Records the size of the decoded image of img, which becomes the most recently used one. A size of zero stops tracking img.
+    void update(const Image *img, qint64 bytes);
+    // Marks img as most recently used, e.g. because it's being displayed again.
+    void touch(const Image *img);
+    // The owner of img cannot release it right now, e.g. because it's displayed. It will be asked again by the next enforceLimit().
+    void decline(const Image *img);
+    // Asks the owners of the least recently used images to release them again, if still beyond the limit, e.g. after a view has been hidden.
+    void enforceLimit();
+
+signals:
+    // The decoded image of img should be released. The pointer is only meant for comparison, as img may have been destroyed by the time this is received.
+    void evictionRequested(const Image *img);
+
+private:
+    DecodedImageBudget();
+
+    void requestEviction(const std::vector<const Image *> &victims);
+
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
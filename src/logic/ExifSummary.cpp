@@ -0,0 +1,286 @@
+
+#include "ExifSummary.hpp"
+
+#include <QtEndian>
+#include <QByteArray>
+#include <cstring>
+
+namespace
+{
+enum : quint16
+{
+    TagModel = 0x0110,
+    TagDateTime = 0x0132,
+    TagExposureTime = 0x829A,
+    TagFNumber = 0x829D,
+    TagExifIfdPointer = 0x8769,
+    TagIsoSpeedRatings = 0x8827,
+    TagDateTimeOriginal = 0x9003,
+    TagDateTimeDigitized = 0x9004,
+    TagFocalLength = 0x920A,
+    TagLensModel = 0xA434,
+};
+
+enum : quint16
+{
+    TypeAscii = 2,
+    TypeShort = 3,
+    TypeLong = 4,
+    TypeRational = 5,
+    TypeIfd = 13,
+};
+
+struct IfdReader
+{
+    const unsigned char *data;
+    qint64 size;
+    bool bigEndian;
+
+    quint16 read16(qint64 off) const
+    {
+        return this->bigEndian ? qFromBigEndian<quint16>(data + off) : qFromLittleEndian<quint16>(data + off);
+    }
+
+    quint32 read32(qint64 off) const
+    {
+        return this->bigEndian ? qFromBigEndian<quint32>(data + off) : qFromLittleEndian<quint32>(data + off);
+    }
+
+    // returns the offset of the value of the IFD entry at entryOff, or -1 if it's out of bounds
+    qint64 valueOffset(qint64 entryOff, qint64 valueSize) const
+    {
+        if(valueSize <= 4)
+        {
+            return entryOff + 8;
+        }
+
+        qint64 off = this->read32(entryOff + 8);
+        return (off + valueSize <= this->size) ? off : -1;
+    }
+
+    bool rational(qint64 entryOff, quint32 &num, quint32 &den) const
+    {
+        if(this->read16(entryOff + 2) != TypeRational || this->read32(entryOff + 4) < 1)
+        {
+            return false;
+        }
+
+        qint64 off = this->valueOffset(entryOff, 8);
+
+        if(off < 0)
+        {
+            return false;
+        }
+
+        num = this->read32(off);
+        den = this->read32(off + 4);
+        return den != 0;
+    }
+
+    QString ascii(qint64 entryOff) const
+    {
+        qint64 count = this->read32(entryOff + 4);
+
+        if(this->read16(entryOff + 2) != TypeAscii || count < 1)
+        {
+            return QString();
+        }
+
+        qint64 off = this->valueOffset(entryOff, count);
+
+        if(off < 0)
+        {
+            return QString();
+        }
+
+        const char *str = reinterpret_cast<const char *>(data + off);
+        return QString::fromUtf8(str, qstrnlen(str, count)).trimmed();
+    }
+
+    bool integer(qint64 entryOff, int64_t &val) const
+    {
+        quint16 type = this->read16(entryOff + 2);
+
+        if(this->read32(entryOff + 4) < 1)
+        {
+            return false;
+        }
+
+        // if count > 1, only the first component is of interest, which is always stored inline for SHORT and LONG
+        switch(type)
+        {
+        case TypeShort:
+            val = this->read16(entryOff + 8);
+            return true;
+
+        case TypeLong:
+        case TypeIfd:
+            val = this->read32(entryOff + 8);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    // returns the number of entries of the IFD at ifdOff, or 0 if it's out of bounds
+    quint16 entries(qint64 ifdOff) const
+    {
+        if(ifdOff < 8 || ifdOff + 2 > this->size)
+        {
+            return 0;
+        }
+
+        quint16 n = this->read16(ifdOff);
+        return (ifdOff + 2 + n * 12 <= this->size) ? n : 0;
+    }
+};
+}
+
+bool ExifSummary::decode(const unsigned char *tiff, qint64 size)
+{
+    *this = ExifSummary();
+
+    if(tiff == nullptr || size < 8)
+    {
+        return false;
+    }
+
+    IfdReader r{tiff, size, false};
+
+    if(std::memcmp(tiff, "MM", 2) == 0)
+    {
+        r.bigEndian = true;
+    }
+    else if(std::memcmp(tiff, "II", 2) != 0)
+    {
+        return false;
+    }
+
+    if(r.read16(2) != 42)
+    {
+        return false;
+    }
+
+    QString dateTime, dateTimeOriginal, dateTimeDigitized;
+    qint64 exifIfd = 0;
+    qint64 ifd0 = r.read32(4);
+    quint16 n = r.entries(ifd0);
+
+    for(quint16 i = 0; i < n; i++)
+    {
+        qint64 entry = ifd0 + 2 + i * 12;
+
+        switch(r.read16(entry))
+        {
+        case TagModel:
+            this->cameraModel = r.ascii(entry);
+            break;
+
+        case TagDateTime:
+            dateTime = r.ascii(entry);
+            break;
+
+        case TagExifIfdPointer:
+        {
+            int64_t off;
+
+            if(r.integer(entry, off))
+            {
+                exifIfd = off;
+            }
+
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    n = r.entries(exifIfd);
+
+    for(quint16 i = 0; i < n; i++)
+    {
+        qint64 entry = exifIfd + 2 + i * 12;
+        quint32 num, den;
+
+        switch(r.read16(entry))
+        {
+        case TagExposureTime:
+            if(r.rational(entry, num, den))
+            {
+                this->exposureNum = num;
+                this->exposureDen = den;
+                this->exposureTime = num * 1.0 / den;
+            }
+
+            break;
+
+        case TagFNumber:
+            if(r.rational(entry, num, den))
+            {
+                this->aperture = num * 1.0 / den;
+            }
+
+            break;
+
+        case TagFocalLength:
+            if(r.rational(entry, num, den))
+            {
+                this->focalLength = num * 1.0 / den;
+            }
+
+            break;
+
+        case TagIsoSpeedRatings:
+            r.integer(entry, this->iso);
+            break;
+
+        case TagDateTimeOriginal:
+            dateTimeOriginal = r.ascii(entry);
+            break;
+
+        case TagDateTimeDigitized:
+            dateTimeDigitized = r.ascii(entry);
+            break;
+
+        case TagLensModel:
+            this->lens = r.ascii(entry);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // same order of preference as KExiv2::getImageDateTime()
+    for(const QString *str : { &dateTimeOriginal, &dateTimeDigitized, &dateTime })
+    {
+        this->dateRecorded = parseDateTime(*str);
+
+        if(this->dateRecorded.isValid())
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+QDateTime ExifSummary::parseDateTime(const QString &str)
+{
+    if(str.isEmpty())
+    {
+        return QDateTime();
+    }
+
+    QDateTime dt = QDateTime::fromString(str, QStringLiteral("yyyy:MM:dd hh:mm:ss"));
+
+    if(!dt.isValid())
+    {
+        dt = QDateTime::fromString(str, Qt::ISODate);
+    }
+
+    return dt;
+}
@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <QDateTime>
+#include <QString>
+#include <cstdint>
+#include <limits>
+
+/**
+ * The EXIF fields that are frequently needed for sorting and sectioning, decoded once when loading the metadata.
+ * Missing numeric fields are set to their maximum value, which makes them sort behind all valid values.
+ */
+struct ExifSummary
+{
+    QDateTime dateRecorded;
+    double aperture = std::numeric_limits<double>::max();
+    double exposureTime = std::numeric_limits<double>::max();
+    quint32 exposureNum = 0;
+    quint32 exposureDen = 0;
+    int64_t iso = std::numeric_limits<int64_t>::max();
+    double focalLength = std::numeric_limits<double>::max();
+    QString lens;
+    QString cameraModel;
+
+    bool hasAperture() const
+    {
+        return this->aperture != std::numeric_limits<double>::max();
+    }
+    bool hasExposureTime() const
+    {
+        return this->exposureDen != 0;
+    }
+    bool hasIso() const
+    {
+        return this->iso != std::numeric_limits<int64_t>::max();
+    }
+    bool hasFocalLength() const
+    {
+        return this->focalLength != std::numeric_limits<double>::max();
+    }
+
+    // Minimal IFD parser, which only reads the tags above from IFD0 and the EXIF IFD of the given TIFF structure.
+    // Returns false if the buffer doesn't look like a TIFF structure.
+    bool decode(const unsigned char *tiff, qint64 size);
+
+    static QDateTime parseDateTime(const QString &str);
+};
@@ -4,6 +4,7 @@
 #include "AfPointOverlay.hpp"
 #include "Formatter.hpp"
 #include "MoonPhase.hpp"
+#include "MetadataLocator.hpp"
 
 #include <QByteArray>
 #include <QImage>
@@ -27,6 +28,29 @@ struct ExifWrapper::Impl
 
     std::optional<KExiv2Iface::KExiv2::ImageOrientation> cachedOrientation;
 
+    ExifSummary summary;
+
+    // the slow path, in case the EXIF structure couldn't be decoded by ExifSummary
+    void summaryFromExiv2(ExifWrapper *q)
+    {
+        this->summary = ExifSummary();
+        this->summary.dateRecorded = q->dateRecorded();
+        q->aperture(this->summary.aperture);
+        q->iso(this->summary.iso);
+        q->focalLength(this->summary.focalLength);
+        this->summary.lens = q->lens();
+        this->summary.cameraModel = q->cameraModel();
+
+        long num, den;
+
+        if(q->exposureTime(num, den) && num >= 0 && den > 0)
+        {
+            this->summary.exposureNum = num;
+            this->summary.exposureDen = den;
+            this->summary.exposureTime = num * 1.0 / den;
+        }
+    }
+
     int dotsPerMeter(const QString &keyName)
     {
         QString keyVal = QStringLiteral("Exif.Image.") + keyName;
@@ -254,7 +278,73 @@ ExifWrapper &ExifWrapper::operator=(const ExifWrapper &other)
 bool ExifWrapper::loadFromData(const QByteArray &data)
 {
     d->cachedOrientation.reset();
-    return d->mExivHandle.loadFromData(data);
+    bool ret = d->mExivHandle.loadFromData(data);
+    d->summaryFromExiv2(this);
+    return ret;
+}
+
+// Only parses the EXIF, XMP, IPTC and comment segments of the given file buffer, rather than handing the entire file to Exiv2.
+// Unlike loadFromData(), the buffer does not need to outlive this object, as Exiv2 decodes the segments into its own structures.
+bool ExifWrapper::loadMetadataSegments(const unsigned char *data, qint64 size)
+{
+    MetadataSegments seg;
+
+    if(!MetadataLocator::locate(data, size, seg))
+    {
+        return this->loadFromData(QByteArray::fromRawData(reinterpret_cast<const char *>(data), size));
+    }
+
+    d->cachedOrientation.reset();
+    d->mExivHandle.clearExif();
+    d->mExivHandle.clearXmp();
+    d->mExivHandle.clearIptc();
+    d->mExivHandle.clearComments();
+
+    if(!seg.exif.isEmpty() && !d->mExivHandle.setExif(seg.exif))
+    {
+        // The EXIF segment was found but couldn't be decoded on its own, e.g. because of an exotic RAW.
+        return this->loadFromData(QByteArray::fromRawData(reinterpret_cast<const char *>(data), size));
+    }
+
+    if(seg.xmp.isEmpty())
+    {
+        // TIFFs store XMP within IFD0
+        seg.xmp = d->mExivHandle.getExifTagData("Exif.Image.XMLPacket");
+    }
+
+    if(!seg.xmp.isEmpty())
+    {
+        d->mExivHandle.setXmp(seg.xmp);
+    }
+
+    if(seg.iptc.isEmpty())
+    {
+        // and IPTC as well
+        seg.iptc = d->mExivHandle.getExifTagData("Exif.Image.IPTCNAA");
+    }
+
+    if(!seg.iptc.isEmpty())
+    {
+        d->mExivHandle.setIptc(seg.iptc);
+    }
+
+    if(!seg.comment.isEmpty())
+    {
+        d->mExivHandle.setComments(seg.comment);
+    }
+
+    // no EXIF means that the date can only be found in XMP or IPTC, which is left to KExiv2
+    if(seg.exif.isEmpty() || !d->summary.decode(reinterpret_cast<const unsigned char *>(seg.exif.constData()), seg.exif.size()))
+    {
+        d->summaryFromExiv2(this);
+    }
+    else if(!d->summary.dateRecorded.isValid())
+    {
+        // the date might still be found in XMP or IPTC, both of which have been handed to KExiv2 above
+        d->summary.dateRecorded = this->dateRecorded();
+    }
+
+    return true;
 }
 
 QString ExifWrapper::errorMessage()
@@ -534,7 +624,17 @@ QString ExifWrapper::exposureTime()
 {
     long num, den;
 
-    if(this->exposureTime(num, den) && den != 0)
+    if(this->exposureTime(num, den))
+    {
+        return formatExposureTime(num, den);
+    }
+
+    return QString();
+}
+
+QString ExifWrapper::formatExposureTime(long num, long den)
+{
+    if(den != 0)
     {
         double quot = num * 1.0 / den;
 
@@ -591,6 +691,11 @@ QString ExifWrapper::lens()
     return d->mExivHandle.getExifTagString("Exif.Photo.LensModel");
 }
 
+QString ExifWrapper::cameraModel()
+{
+    return d->mExivHandle.getExifTagString("Exif.Image.Model");
+}
+
 bool ExifWrapper::focalLength(double &quot)
 {
     long num, den;
@@ -834,3 +939,8 @@ QString ExifWrapper::formatToString()
 
     return QString(f.str().c_str());
 }
+
+const ExifSummary &ExifWrapper::summary() const
+{
+    return d->summary;
+}
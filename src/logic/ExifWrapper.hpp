@@ -2,6 +2,7 @@
 #pragma once
 
 #include "AfPointOverlay.hpp"
+#include "ExifSummary.hpp"
 
 #include <memory>
 #include <QString>
@@ -30,6 +31,7 @@ public:
     ExifWrapper &operator=(const ExifWrapper &);
 
     bool loadFromData(const QByteArray &data);
+    bool loadMetadataSegments(const unsigned char *data, qint64 size);
     QString errorMessage();
     qreal rotation();
     QTransform rotationMatrix();
@@ -48,6 +50,7 @@ public:
     bool aperture(double &quot);
 
     QString exposureTime();
+    static QString formatExposureTime(long num, long den);
     bool exposureTime(double &quot);
     bool exposureTime(long &num, long &den);
 
@@ -55,6 +58,7 @@ public:
     bool iso(int64_t &num);
 
     QString lens();
+    QString cameraModel();
 
     bool focalLength(double &quot);
     QString focalLength();
@@ -70,6 +74,9 @@ public:
 
     QString formatToString();
 
+    // pre-decoded fields used for sorting, which are cheap to access
+    const ExifSummary &summary() const;
+
 private:
     struct Impl;
     std::unique_ptr<Impl> d;
@@ -8,6 +8,7 @@
 #include "ANPV.hpp"
 #include "SmartImageDecoder.hpp"
 #include "LibRawHelper.hpp"
+#include "DecodedImageBudget.hpp"
 
 #include <QPointer>
 #include <QDir>
@@ -15,13 +16,42 @@
 #include <QAbstractFileIconProvider>
 #include <QMetaMethod>
 #include <QTimer>
+#include <QCoreApplication>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 struct Image::Impl
 {
+    // icon heights are rounded up to multiples of this, so that resizing icons doesn't render a new thumbnail for every pixel
+    static constexpr int RenditionBucketStep = 32;
+    // e.g. one for the thumbnail list and one for the tab bar, plus the one for the previous icon height
+    static constexpr size_t MaxRenditions = 3;
+
+    // the thumbnail rotated according to EXIF orientation and scaled to the height of a bucket
+    struct Rendition
+    {
+        int bucket;
+        QImage image;
+    };
+
+    // A low resolution preview image of the original full image, together with its renditions.
+    // Published as immutable snapshot, so that painting never waits for decoding threads.
+    struct Thumbnail
+    {
+        QImage image;
+        // the size of image after rotating it, i.e. the aspect ratio of all renditions
+        QSize transformedSize;
+        std::vector<Rendition> renditions;
+    };
+
     mutable std::recursive_mutex m;
 
-    DecodingState state{ DecodingState::Unknown };
+    // frequently read by the UI thread, hence atomic rather than guarded by m; writers still hold m to serialize modifications
+    std::atomic<DecodingState> state{ DecodingState::Unknown };
 
     // Quick reference to the decoder, possibly an owning reference as well
     QSharedPointer<SmartImageDecoder> decoder;
@@ -31,19 +61,22 @@ struct Image::Impl
     // file path to the decoded input file
     const QFileInfo fileInfo;
 
-    // a low resolution preview image of the original full image
-    QImage thumbnail;
-
-    // same as thumbnail, but rotated according to EXIF orientation
-    QPixmap thumbnailTransformed;
+    std::atomic<std::shared_ptr<const Thumbnail>> thumbnail;
+    // the buckets whose renditions are currently being rendered in the background, only accessed by the UI thread
+    std::vector<int> pendingRenditions;
+    // Pixmaps of the most recently used renditions, keyed by the cacheKey() of their image, only accessed by the UI thread.
+    // They're kept out of the thumbnail snapshot, as that may be released by any thread, and QPixmaps must not be destroyed outside the UI thread.
+    std::vector<std::pair<qint64, QPixmap>> renditionPixmaps;
 
     QIcon icon;
 
     // the fully decoded image - might be incomplete if the state is PreviewImage
     QImage decodedImage;
+    // maps decodedImage to full resolution coordinates, as passed to setDecodedImage()
+    QTransform decodedImageTransform;
 
     // size of the fully decoded image, already available in DecodingState::Metadata
-    QSize size;
+    std::atomic<QSize> size{ QSize() };
 
     QSharedPointer<ExifWrapper> exifWrapper;
 
@@ -61,22 +94,112 @@ struct Image::Impl
     QRect cachedUpdateRect;
 
     // indicates whether this instance has been marked by the user
-    Qt::CheckState checked = Qt::Unchecked;
+    std::atomic<Qt::CheckState> checked{ Qt::Unchecked };
 
     Impl(const QFileInfo &url) : fileInfo(url)
     {}
 
     QTransform transformMatrixOrIdentity()
     {
-        if(this->exifWrapper)
+        std::unique_lock<std::recursive_mutex> lck(this->m);
+        QSharedPointer<ExifWrapper> exif = this->exifWrapper;
+        lck.unlock();
+
+        if(exif)
         {
-            return this->exifWrapper->transformMatrix();
+            return exif->transformMatrix();
         }
         else
         {
             return QTransform();
         }
     }
+
+    static int renditionBucket(int height)
+    {
+        return (height + RenditionBucketStep - 1) / RenditionBucketStep * RenditionBucketStep;
+    }
+
+    // may be called from any thread, as it doesn't involve QPixmap
+    static QImage renderThumbnail(const QImage &thumb, const QTransform &trafo, int bucket)
+    {
+        return thumb.transformed(trafo).scaledToHeight(bucket, Qt::SmoothTransformation);
+    }
+
+    // Returns the rendition of thumb of the given bucket, otherwise the largest one, nullptr if there is none at all.
+    static const Rendition *findRendition(const Thumbnail &thumb, int bucket)
+    {
+        const Rendition *best = nullptr;
+
+        for(const Rendition &r : thumb.renditions)
+        {
+            // prefer the matching bucket, otherwise the largest one
+            if(r.bucket == bucket || best == nullptr || (best->bucket != bucket && r.bucket > best->bucket))
+            {
+                best = &r;
+            }
+        }
+
+        return best;
+    }
+
+    // Returns the pixmap of a rendition's image, converting it once. Must be called from the UI thread.
+    QPixmap renditionPixmap(const QImage &image, TraceTimer &t)
+    {
+        const qint64 key = image.cacheKey();
+        auto it = std::find_if(this->renditionPixmaps.begin(), this->renditionPixmaps.end(), [key](const auto & p)
+        {
+            return p.first == key;
+        });
+
+        if(it != this->renditionPixmaps.end())
+        {
+            t.setInfo("using cached rendition");
+            return it->second;
+        }
+
+        t.setInfo(Formatter() << "converting rendition of height " << image.height() << "px to pixmap");
+        QPixmap pix = QPixmap::fromImage(image, Qt::ColorOnly | Qt::DiffuseDither);
+
+        if(this->renditionPixmaps.size() >= MaxRenditions)
+        {
+            this->renditionPixmaps.erase(this->renditionPixmaps.begin());
+        }
+
+        this->renditionPixmaps.emplace_back(key, pix);
+        return pix;
+    }
+
+    // Adds rendition to the current thumbnail, replacing any other one of the same bucket. Fails if the thumbnail has been replaced meanwhile.
+    bool publishRendition(std::shared_ptr<const Thumbnail> expected, const QImage &renderedFrom, Rendition rendition)
+    {
+        std::shared_ptr<Thumbnail> record;
+
+        do
+        {
+            if(!expected || expected->image.cacheKey() != renderedFrom.cacheKey())
+            {
+                return false;
+            }
+
+            record = std::make_shared<Thumbnail>(*expected);
+            std::erase_if(record->renditions, [&](const Rendition & r)
+            {
+                return r.bucket == rendition.bucket;
+            });
+
+            record->renditions.push_back(rendition);
+
+            if(record->renditions.size() > MaxRenditions)
+            {
+                // the least recently added one
+                record->renditions.erase(record->renditions.begin());
+            }
+        }
+        while(!this->thumbnail.compare_exchange_weak(expected, record));
+
+        return true;
+    }
 };
 
 Image::Image(const QFileInfo &url) : AbstractListItem(ListItemType::Image), d(std::make_unique<Impl>(url))
@@ -105,6 +228,7 @@ Image::Image(const QFileInfo &url) : AbstractListItem(ListItemType::Image), d(st
 Image::~Image()
 {
     xThreadGuard g(this);
+    DecodedImageBudget::globalInstance()->update(this, 0);
 }
 
 QString Image::getName() const
@@ -114,7 +238,6 @@ QString Image::getName() const
 
 bool Image::hasDecoder() const
 {
-    std::unique_lock<std::recursive_mutex> lck(d->m);
     return d->state != DecodingState::Unknown;
 }
 
@@ -126,13 +249,11 @@ const QFileInfo &Image::fileInfo() const
 
 QSize Image::size() const
 {
-    std::unique_lock<std::recursive_mutex> lck(d->m);
     return d->size;
 }
 
 void Image::setSize(QSize size)
 {
-    std::unique_lock<std::recursive_mutex> lck(d->m);
     d->size = size;
 }
 
@@ -156,8 +277,8 @@ void Image::setUserTransform(QTransform trans)
 
 QImage Image::thumbnail()
 {
-    std::unique_lock<std::recursive_mutex> lck(d->m);
-    return d->thumbnail;
+    std::shared_ptr<const Impl::Thumbnail> t = d->thumbnail.load();
+    return t ? t->image : QImage();
 }
 
 void Image::setThumbnail(QImage thumb)
@@ -170,28 +291,41 @@ void Image::setThumbnail(QImage thumb)
     // don't hold the lock when querying this
     auto iconHeight = ANPV::globalInstance()->iconHeight();
 
-    thumb.convertTo(QImage::Format_ARGB32_Premultiplied, Qt::ColorOnly | Qt::OrderedDither);
-    
-    std::unique_lock<std::recursive_mutex> lck(d->m);
+    std::shared_ptr<const Impl::Thumbnail> cur = d->thumbnail.load();
 
-    if(thumb.width() > d->thumbnail.width())
+    if(cur && thumb.width() <= cur->image.width())
     {
-        d->thumbnail = thumb;
-        d->thumbnailTransformed = QPixmap();
+        return;
+    }
 
-        if(!thumb.isNull())
-        {
-            // precompute and transform the thumbnail for the UI thread, before we are announcing that a thumbnail is available
-            this->thumbnailTransformed(iconHeight);
-        }
+    thumb.convertTo(QImage::Format_ARGB32_Premultiplied, Qt::ColorOnly | Qt::OrderedDither);
 
-        lck.unlock();
+    // render the thumbnail for the UI thread while we're still in the decoding thread, before we are announcing that a thumbnail is available
+    QTransform trafo = d->transformMatrixOrIdentity();
+    auto record = std::make_shared<Impl::Thumbnail>();
+    record->image = thumb;
+    record->transformedSize = trafo.mapRect(thumb.rect()).size();
+
+    if(iconHeight > 0)
+    {
+        int bucket = Impl::renditionBucket(iconHeight);
+        record->renditions.push_back(Impl::Rendition{ bucket, Impl::renderThumbnail(thumb, trafo, bucket) });
+    }
 
-        if(!this->signalsBlocked())
+    do
+    {
+        if(cur && thumb.width() <= cur->image.width())
         {
-            emit this->thumbnailChanged(this, d->thumbnail);
+            // another thread has published a larger one in the meantime
+            return;
         }
     }
+    while(!d->thumbnail.compare_exchange_weak(cur, record));
+
+    if(!this->signalsBlocked())
+    {
+        emit this->thumbnailChanged(this, thumb);
+    }
 }
 
 QIcon Image::icon()
@@ -216,6 +350,8 @@ void Image::lookupIconFromFileType()
     this->setIcon(ico);
 }
 
+// Returns the thumbnail rotated according to EXIF orientation, at least as high as height if available. Must be called from the UI thread.
+// Missing renditions are rendered in the background and announced via thumbnailChanged(), meanwhile the closest one available is returned.
 QPixmap Image::thumbnailTransformed(int height)
 {
     if(height <= 0)
@@ -224,55 +360,122 @@ QPixmap Image::thumbnailTransformed(int height)
     }
 
     TraceTimer t(typeid(Image), 10);
-    std::unique_lock<std::recursive_mutex> lck(d->m);
 
-    QPixmap pix;
-    QPixmap thumb = QPixmap::fromImage(this->thumbnail(), Qt::ColorOnly | Qt::DiffuseDither);
+    std::shared_ptr<const Impl::Thumbnail> thumb = d->thumbnail.load();
 
-    if(thumb.isNull())
+    if(thumb)
     {
-        pix = this->icon().pixmap(height);
+        const int bucket = Impl::renditionBucket(height);
+        const Impl::Rendition *best = Impl::findRendition(*thumb, bucket);
 
-        if(pix.isNull())
+        if(best == nullptr || best->bucket != bucket)
         {
-            t.setInfo("no icon found, drawing our own...");
-            auto state = this->decodingState();
-
-            if(this->hasDecoder() && state != DecodingState::Error && state != DecodingState::Fatal)
-            {
-                pix = ANPV::globalInstance()->noPreviewPixmap();
-            }
-            else
-            {
-                pix = ANPV::globalInstance()->noIconPixmap();
-            }
+            this->requestRendition(bucket);
         }
-        else
+
+        if(best != nullptr)
         {
-            t.setInfo("using icon from QFileIconProvider");
+            return d->renditionPixmap(best->image, t);
         }
 
-        Q_ASSERT(!pix.isNull());
+        t.setInfo("rendition pending");
     }
-    else
+
+    QPixmap pix = this->icon().pixmap(height);
+
+    if(pix.isNull())
     {
-        int currentHeight = d->thumbnailTransformed.height();
+        t.setInfo("no icon found, drawing our own...");
+        auto state = this->decodingState();
 
-        if(!d->thumbnailTransformed.isNull() && currentHeight >= height)
+        if(this->hasDecoder() && state != DecodingState::Error && state != DecodingState::Fatal)
         {
-            t.setInfo("using cached thumbnail, size is sufficient");
-            return currentHeight == height ? d->thumbnailTransformed : d->thumbnailTransformed.scaledToHeight(height, Qt::FastTransformation);
+            pix = ANPV::globalInstance()->noPreviewPixmap();
         }
+        else
+        {
+            pix = ANPV::globalInstance()->noIconPixmap();
+        }
+    }
+    else
+    {
+        t.setInfo("using icon from QFileIconProvider");
+    }
+
+    Q_ASSERT(!pix.isNull());
+    return pix.scaledToHeight(height, Qt::FastTransformation);
+}
+
+// Like thumbnailTransformed(), but returns the rendition itself, without converting it to a pixmap. Null if there is no thumbnail (yet).
+// Meant for painting, as it requests a missing rendition as well. Must be called from the UI thread.
+QImage Image::thumbnailImage(int height)
+{
+    std::shared_ptr<const Impl::Thumbnail> thumb = d->thumbnail.load();
+
+    if(height <= 0 || !thumb)
+    {
+        return QImage();
+    }
 
-        int currentWidth = thumb.width();
-        currentHeight = thumb.height();
-        t.setInfo(Formatter() << "no matching thumbnail cached, transforming and scaling a thumbnail with an original size of " << currentWidth << "x" << currentHeight << "px to height " << height << "px");
-        pix = thumb.transformed(d->transformMatrixOrIdentity());
+    const int bucket = Impl::renditionBucket(height);
+    const Impl::Rendition *best = Impl::findRendition(*thumb, bucket);
+
+    if(best == nullptr || best->bucket != bucket)
+    {
+        this->requestRendition(bucket);
     }
 
-    pix = pix.scaledToHeight(height, Qt::FastTransformation);
-    d->thumbnailTransformed = pix;
-    return pix;
+    return best != nullptr ? best->image : QImage();
+}
+
+// The size of the thumbnail rotated according to EXIF orientation, invalid if there is none (yet).
+// Unlike the renditions, it doesn't depend on any icon height, so it's meant for layouting. Has no side effects.
+QSize Image::thumbnailSize()
+{
+    std::shared_ptr<const Impl::Thumbnail> thumb = d->thumbnail.load();
+    return thumb ? thumb->transformedSize : QSize();
+}
+
+// renders the thumbnail for the given bucket in the thread pool, unless already in progress
+void Image::requestRendition(int bucket)
+{
+    xThreadGuard g(this);
+
+    std::shared_ptr<const Impl::Thumbnail> thumb = d->thumbnail.load();
+
+    if(!thumb || std::find(d->pendingRenditions.begin(), d->pendingRenditions.end(), bucket) != d->pendingRenditions.end())
+    {
+        return;
+    }
+
+    d->pendingRenditions.push_back(bucket);
+
+    QImage source = thumb->image;
+    QTransform trafo = d->transformMatrixOrIdentity();
+    QPointer<Image> self(this);
+
+    ANPV::globalInstance()->threadPool()->start([self, source, trafo, bucket]()
+    {
+        QImage rendered = Impl::renderThumbnail(source, trafo, bucket);
+
+        // Image lives in the UI thread; the pixmap is only created once someone asks for it, see thumbnailTransformed()
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [self, source, rendered, bucket]()
+        {
+            if(!self)
+            {
+                return;
+            }
+
+            std::erase(self->d->pendingRenditions, bucket);
+
+            Impl::Rendition r{ bucket, rendered };
+
+            if(self->d->publishRendition(self->d->thumbnail.load(), source, r) && !self->signalsBlocked())
+            {
+                emit self->thumbnailChanged(self.data(), source);
+            }
+        }, Qt::QueuedConnection);
+    }, static_cast<int>(Priority::Normal));
 }
 
 QSharedPointer<ExifWrapper> Image::exif()
@@ -463,8 +666,11 @@ void Image::setNeighbor(const QSharedPointer<Image>& newNeighbor)
     {
         connect(newNeighbor.get(), &Image::destroyed, this, [&]()
             {
+                std::unique_lock<std::recursive_mutex> lck(d->m);
                 d->neighbor = nullptr;
-                emit this->thumbnailChanged(this, d->thumbnail);
+                lck.unlock();
+
+                emit this->thumbnailChanged(this, this->thumbnail());
                 emit this->checkStateChanged(this, d->checked, d->checked);
             });
 
@@ -477,7 +683,10 @@ void Image::setNeighbor(const QSharedPointer<Image>& newNeighbor)
 
                     if (before != after)
                     {
+                        std::unique_lock<std::recursive_mutex> lck(d->m);
                         auto n = d->neighbor.toStrongRef();
+                        lck.unlock();
+
                         if (n)
                         {
                             bool previewIsChecked = n->checked();
@@ -501,21 +710,25 @@ void Image::setNeighbor(const QSharedPointer<Image>& newNeighbor)
                 });
         }
 
-        emit this->thumbnailChanged(this, d->thumbnail);
+        emit this->thumbnailChanged(this, this->thumbnail());
         emit this->checkStateChanged(this, newNeighbor->d->checked, d->checked);
     }
 }
 
 bool Image::hideIfNonRawAvailable(ViewFlags_t viewFlags) const
 {
-    return ((viewFlags & static_cast<ViewFlags_t>(ViewFlag::CombineRawJpg)) != 0)
-           && this->isRaw()
-           && d->neighbor;
+    if(((viewFlags & static_cast<ViewFlags_t>(ViewFlag::CombineRawJpg)) == 0) || !this->isRaw())
+    {
+        return false;
+    }
+
+    // the neighbor is set and reset from other threads
+    std::unique_lock<std::recursive_mutex> lck(d->m);
+    return !d->neighbor.isNull();
 }
 
 DecodingState Image::decodingState() const
 {
-    std::unique_lock<std::recursive_mutex> lck(d->m);
     return d->state;
 }
 
@@ -556,12 +769,16 @@ void Image::setErrorMessage(const QString &err)
 
 Qt::CheckState Image::checked()
 {
-    std::unique_lock<std::recursive_mutex> lck(d->m);
-
-    auto n = d->neighbor.toStrongRef();
-    if (n && this->hideIfNonRawAvailable(ANPV::globalInstance()->viewFlags()))
+    if (this->hideIfNonRawAvailable(ANPV::globalInstance()->viewFlags()))
     {
-        return n->checked();
+        std::unique_lock<std::recursive_mutex> lck(d->m);
+        auto n = d->neighbor.toStrongRef();
+        lck.unlock();
+
+        if (n)
+        {
+            return n->checked();
+        }
     }
 
     return d->checked;
@@ -570,7 +787,7 @@ Qt::CheckState Image::checked()
 void Image::setChecked(Qt::CheckState b)
 {
     std::unique_lock<std::recursive_mutex> lck(d->m);
-    auto old = d->checked;
+    Qt::CheckState old = d->checked;
 
     if(old != b)
     {
@@ -599,8 +816,10 @@ void Image::setDecodedImage(QImage img, QTransform scale)
     std::unique_lock<std::recursive_mutex> lck(d->m);
     // skip comparison with current image, can be slow
     d->decodedImage = img;
+    d->decodedImageTransform = scale;
     lck.unlock();
-    emit this->decodedImageChanged(this, d->decodedImage, scale);
+    DecodedImageBudget::globalInstance()->update(this, img.sizeInBytes());
+    emit this->decodedImageChanged(this, img, scale);
 }
 
 void Image::updatePreviewImage(const QRect &r)
@@ -648,11 +867,14 @@ void Image::connectNotify(const QMetaMethod &signal)
     }
     else if(signal.name() == QStringLiteral("decodedImageChanged"))
     {
-        QImage img = this->decodedImage();
+        std::unique_lock<std::recursive_mutex> lck(d->m);
+        QImage img = d->decodedImage;
+        QTransform scale = d->decodedImageTransform;
+        lck.unlock();
 
         if(!img.isNull())
         {
-            emit this->decodedImageChanged(this, img, QTransform());
+            emit this->decodedImageChanged(this, img, scale);
         }
     }
     else if(signal.name() == QStringLiteral("checkStateChanged"))
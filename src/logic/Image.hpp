@@ -26,6 +26,7 @@ class QMetaMethod;
 
 /**
  * Thread-safe container for most of decoded information of an image.
+ * The fields read while painting (decoding state, size, check state and thumbnail) are read without locking.
  * Owned and used by the main-thread to know about most useful information.
  * Fed by the background decoding thread.
  * Will also be used for other regular files and folders.
@@ -65,6 +66,8 @@ public:
 
     QImage thumbnail();
     QPixmap thumbnailTransformed(int height);
+    QImage thumbnailImage(int height);
+    QSize thumbnailSize();
     QIcon icon();
 
     QSharedPointer<SmartImageDecoder> decoder();
@@ -116,6 +119,8 @@ protected:
     void updatePreviewImage(const QRect &r);
 
 private:
+    void requestRendition(int bucket);
+
     struct Impl;
     std::unique_ptr<Impl> d;
 };
@@ -0,0 +1,339 @@
+
+#include "MetadataLocator.hpp"
+
+#include <cstring>
+
+static quint16 readBigEndian16(const unsigned char *p)
+{
+    return static_cast<quint16>((p[0] << 8) | p[1]);
+}
+
+static quint32 readBigEndian32(const unsigned char *p)
+{
+    return (static_cast<quint32>(p[0]) << 24) | (static_cast<quint32>(p[1]) << 16) | (static_cast<quint32>(p[2]) << 8) | p[3];
+}
+
+static quint64 readBigEndian64(const unsigned char *p)
+{
+    return (static_cast<quint64>(readBigEndian32(p)) << 32) | readBigEndian32(p + 4);
+}
+
+static QByteArray wrap(const unsigned char *p, qint64 len)
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(p), len);
+}
+
+static bool isTiff(const unsigned char *data, qint64 size)
+{
+    // BigTIFF (43) is intentionally not accepted here, it's not supported by Exiv2's ExifParser
+    return size >= 8 && ((std::memcmp(data, "II\x2A\x00", 4) == 0) || (std::memcmp(data, "MM\x00\x2A", 4) == 0));
+}
+
+bool MetadataLocator::locate(const unsigned char *data, qint64 size, MetadataSegments &out)
+{
+    out = MetadataSegments();
+
+    if(data == nullptr || size < 12)
+    {
+        return false;
+    }
+
+    if(data[0] == 0xFF && data[1] == 0xD8)
+    {
+        return locateJpeg(data, size, out);
+    }
+
+    if(isTiff(data, size))
+    {
+        // IFD0 is the file itself, and so are TIFF based RAWs like CR2, NEF, ARW or DNG
+        out.exif = wrap(data, size);
+        return true;
+    }
+
+    if(std::memcmp(data, "\x89PNG\r\n\x1A\n", 8) == 0)
+    {
+        return locatePng(data, size, out);
+    }
+
+    if(std::memcmp(data, "\x00\x00\x00\x0CJXL \r\n\x87\n", 12) == 0)
+    {
+        return locateJxl(data, size, out);
+    }
+
+    if(data[0] == 0xFF && data[1] == 0x0A)
+    {
+        // a bare JXL codestream, which cannot carry any EXIF or XMP
+        return true;
+    }
+
+    return false;
+}
+
+// Walks the image resource blocks of a Photoshop APP13 segment (without its signature), looking for the IPTC-IIM resource.
+bool MetadataLocator::locatePhotoshopIptc(const unsigned char *data, qint64 size, MetadataSegments &out)
+{
+    static constexpr quint16 IptcResourceId = 0x0404;
+
+    qint64 pos = 0;
+
+    while(pos + 12 <= size)
+    {
+        if(std::memcmp(data + pos, "8BIM", 4) != 0)
+        {
+            return false;
+        }
+
+        const quint16 id = readBigEndian16(data + pos + 4);
+        // the name is a pascal string, padded to an even size including the length byte
+        const qint64 nameLen = (data[pos + 6] + 2) & ~qint64(1);
+        pos += 6 + nameLen;
+
+        if(pos + 4 > size)
+        {
+            return false;
+        }
+
+        const qint64 len = readBigEndian32(data + pos);
+        pos += 4;
+
+        if(len > size - pos)
+        {
+            return false;
+        }
+
+        if(id == IptcResourceId)
+        {
+            out.iptc = wrap(data + pos, len);
+            return true;
+        }
+
+        // the data is padded to an even size as well
+        pos += (len + 1) & ~qint64(1);
+    }
+
+    return true;
+}
+
+bool MetadataLocator::locateJpeg(const unsigned char *data, qint64 size, MetadataSegments &out)
+{
+    static constexpr char ExifSig[] = "Exif\0";
+    static constexpr char XmpSig[] = "http://ns.adobe.com/xap/1.0/";
+    static constexpr char PhotoshopSig[] = "Photoshop 3.0";
+    bool foundPhotoshop = false;
+
+    qint64 pos = 2;
+
+    while(pos + 4 <= size)
+    {
+        if(data[pos] != 0xFF)
+        {
+            // corrupt marker structure, let Exiv2 deal with it
+            return false;
+        }
+
+        const unsigned char marker = data[pos + 1];
+
+        if(marker == 0xFF)
+        {
+            // fill byte
+            pos++;
+            continue;
+        }
+
+        pos += 2;
+
+        if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+        {
+            // markers without payload
+            continue;
+        }
+
+        if(marker == 0xDA || marker == 0xD9)
+        {
+            // SOS or EOI: all metadata must have been seen by now
+            break;
+        }
+
+        const qint64 len = readBigEndian16(data + pos);
+
+        if(len < 2 || pos + len > size)
+        {
+            return false;
+        }
+
+        const unsigned char *payload = data + pos + 2;
+        const qint64 payloadLen = len - 2;
+
+        if(marker == 0xE1)
+        {
+            if(out.exif.isEmpty() && payloadLen > qint64(sizeof(ExifSig)) && std::memcmp(payload, ExifSig, sizeof(ExifSig)) == 0)
+            {
+                out.exif = wrap(payload + sizeof(ExifSig), payloadLen - sizeof(ExifSig));
+            }
+            else if(out.xmp.isEmpty() && payloadLen > qint64(sizeof(XmpSig)) && std::memcmp(payload, XmpSig, sizeof(XmpSig)) == 0)
+            {
+                out.xmp = wrap(payload + sizeof(XmpSig), payloadLen - sizeof(XmpSig));
+            }
+        }
+        else if(marker == 0xED && payloadLen >= qint64(sizeof(PhotoshopSig)) && std::memcmp(payload, PhotoshopSig, sizeof(PhotoshopSig)) == 0)
+        {
+            if(foundPhotoshop)
+            {
+                // the resources are split across multiple segments, let Exiv2 reassemble them
+                return false;
+            }
+
+            foundPhotoshop = true;
+
+            if(!locatePhotoshopIptc(payload + sizeof(PhotoshopSig), payloadLen - sizeof(PhotoshopSig), out))
+            {
+                return false;
+            }
+        }
+        else if(marker == 0xFE && out.comment.isEmpty())
+        {
+            out.comment = wrap(payload, payloadLen);
+        }
+
+        pos += len;
+    }
+
+    return true;
+}
+
+bool MetadataLocator::locatePng(const unsigned char *data, qint64 size, MetadataSegments &out)
+{
+    static constexpr char XmpKeyword[] = "XML:com.adobe.xmp";
+    static constexpr char RawProfileKeyword[] = "Raw profile type";
+
+    qint64 pos = 8;
+
+    while(pos + 12 <= size)
+    {
+        const qint64 len = readBigEndian32(data + pos);
+        const unsigned char *type = data + pos + 4;
+        const unsigned char *payload = data + pos + 8;
+
+        if(len > size - pos - 12)
+        {
+            return false;
+        }
+
+        if(std::memcmp(type, "eXIf", 4) == 0)
+        {
+            if(out.exif.isEmpty())
+            {
+                out.exif = wrap(payload, len);
+            }
+        }
+        else if(std::memcmp(type, "iTXt", 4) == 0)
+        {
+            // keyword\0, compression flag, compression method, language tag\0, translated keyword\0, text
+            if(out.xmp.isEmpty() && len > qint64(sizeof(XmpKeyword)) + 1 && std::memcmp(payload, XmpKeyword, sizeof(XmpKeyword)) == 0)
+            {
+                const unsigned char *end = payload + len;
+                const unsigned char *p = payload + sizeof(XmpKeyword);
+
+                if(p[0] != 0)
+                {
+                    // compressed XMP is rare, leave it to Exiv2
+                    return false;
+                }
+
+                p += 2;
+
+                for(int skip = 0; skip < 2 && p < end; p++)
+                {
+                    if(*p == 0)
+                    {
+                        skip++;
+                    }
+                }
+
+                out.xmp = wrap(p, end - p);
+            }
+        }
+        else if(std::memcmp(type, "tEXt", 4) == 0 || std::memcmp(type, "zTXt", 4) == 0)
+        {
+            // legacy ImageMagick style EXIF / XMP profiles are hex encoded (and possibly compressed), leave them to Exiv2
+            if(len > qint64(sizeof(RawProfileKeyword)) && std::memcmp(payload, RawProfileKeyword, sizeof(RawProfileKeyword) - 1) == 0)
+            {
+                return false;
+            }
+        }
+        else if(std::memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        pos += 12 + len;
+    }
+
+    return true;
+}
+
+bool MetadataLocator::locateJxl(const unsigned char *data, qint64 size, MetadataSegments &out)
+{
+    qint64 pos = 0;
+
+    while(pos + 8 <= size)
+    {
+        quint64 boxSize = readBigEndian32(data + pos);
+        const unsigned char *type = data + pos + 4;
+        qint64 headerSize = 8;
+
+        if(boxSize == 1)
+        {
+            if(pos + 16 > size)
+            {
+                return false;
+            }
+
+            boxSize = readBigEndian64(data + pos + 8);
+            headerSize = 16;
+        }
+        else if(boxSize == 0)
+        {
+            // box extends to the end of file
+            boxSize = size - pos;
+        }
+
+        if(boxSize < quint64(headerSize) || boxSize > quint64(size - pos))
+        {
+            return false;
+        }
+
+        const unsigned char *payload = data + pos + headerSize;
+        const qint64 payloadLen = boxSize - headerSize;
+
+        if(std::memcmp(type, "Exif", 4) == 0)
+        {
+            // the payload starts with the offset to the TIFF header
+            if(out.exif.isEmpty() && payloadLen > 4)
+            {
+                const qint64 tiffOffset = readBigEndian32(payload);
+
+                if(tiffOffset < payloadLen - 4)
+                {
+                    out.exif = wrap(payload + 4 + tiffOffset, payloadLen - 4 - tiffOffset);
+                }
+            }
+        }
+        else if(std::memcmp(type, "xml ", 4) == 0)
+        {
+            if(out.xmp.isEmpty())
+            {
+                out.xmp = wrap(payload, payloadLen);
+            }
+        }
+        else if(std::memcmp(type, "brob", 4) == 0)
+        {
+            // brotli compressed metadata box
+            return false;
+        }
+
+        pos += boxSize;
+    }
+
+    return true;
+}
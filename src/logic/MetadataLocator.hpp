@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <QByteArray>
+
+/**
+ * The raw metadata payloads of an encoded image file. The byte arrays usually do not own their data,
+ * i.e. they point into the buffer that has been passed to MetadataLocator::locate().
+ */
+struct MetadataSegments
+{
+    // a TIFF structure, starting with the byte order mark ("II" or "MM")
+    QByteArray exif;
+    // the XMP packet
+    QByteArray xmp;
+    // the IPTC-IIM records, i.e. the payload of the Photoshop image resource 0x0404
+    QByteArray iptc;
+    // a JPEG COM segment
+    QByteArray comment;
+};
+
+/**
+ * Finds the EXIF, XMP, IPTC and comment segments of an in-memory (usually mmapped) image file by walking the
+ * container structure only, i.e. without touching the pages holding the compressed image data.
+ */
+class MetadataLocator
+{
+public:
+    MetadataLocator() = delete;
+
+    // Returns false if the container format is unknown or cannot be handled without a full parse.
+    // Returns true if the container has been understood, even if no metadata was found.
+    static bool locate(const unsigned char *data, qint64 size, MetadataSegments &out);
+
+private:
+    static bool locatePhotoshopIptc(const unsigned char *data, qint64 size, MetadataSegments &out);
+    static bool locateJpeg(const unsigned char *data, qint64 size, MetadataSegments &out);
+    static bool locatePng(const unsigned char *data, qint64 size, MetadataSegments &out);
+    static bool locateJxl(const unsigned char *data, qint64 size, MetadataSegments &out);
+};
@@ -0,0 +1,390 @@
+
+#include "PyramidSidecar.hpp"
+
+#include "BoxDecimator.hpp"
+#include "ANPV.hpp"
+#include "SmartImageDecoder.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtDebug>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "tiffio.h"
+
+namespace
+{
+std::atomic<bool> sidecarsEnabled = false;
+std::atomic<qint64> sidecarCacheLimit = PyramidSidecar::DefaultCacheLimit;
+
+// sidecars currently being generated, to avoid generating the same one twice
+std::mutex inProgressMtx;
+std::set<QString> inProgress;
+
+// Halves the resolution of src, converting it to 32 bit ARGB if necessary
+QImage halve(const QImage &src)
+{
+    QSize size = BoxDecimator::decimatedSize(src.size(), 2);
+    QImage dst(size, QImage::Format_ARGB32);
+
+    if(dst.isNull())
+    {
+        return QImage();
+    }
+
+    BoxDecimator dec(src.width(), src.height(), 2, reinterpret_cast<uint32_t *>(dst.bits()), dst.bytesPerLine() / sizeof(uint32_t));
+
+    for(int y = 0; y < src.height(); y++)
+    {
+        // wraps the row without copying it, the conversion is a no-op for ARGB32
+        QImage row = QImage(src.constScanLine(y), src.width(), 1, src.bytesPerLine(), src.format()).convertToFormat(QImage::Format_ARGB32);
+        dec.addPixels(0, y, reinterpret_cast<const uint32_t *>(row.constBits()), src.width());
+        dec.flush(y + 1);
+    }
+
+    return dst;
+}
+
+bool writeLevel(TIFF *tif, const QImage &level)
+{
+    TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, level.width());
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, level.height());
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 4);
+    uint16_t extra[] = { EXTRASAMPLE_UNASSALPHA };
+    TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, extra);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, PyramidSidecar::TileSize);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, PyramidSidecar::TileSize);
+
+    if(TIFFIsCODECConfigured(COMPRESSION_ADOBE_DEFLATE))
+    {
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+        // favour speed, the sidecar is only a cache
+        TIFFSetField(tif, TIFFTAG_ZIPQUALITY, 1);
+    }
+
+    const int ts = PyramidSidecar::TileSize;
+    std::vector<uchar> tile(static_cast<size_t>(ts) * ts * 4);
+
+    for(int y = 0; y < level.height(); y += ts)
+    {
+        for(int x = 0; x < level.width(); x += ts)
+        {
+            QImage rgba = level.copy(x, y, ts, ts).convertToFormat(QImage::Format_RGBA8888);
+
+            for(int r = 0; r < ts; r++)
+            {
+                std::memcpy(&tile[static_cast<size_t>(r) * ts * 4], rgba.constScanLine(r), static_cast<size_t>(ts) * 4);
+            }
+
+            if(TIFFWriteTile(tif, tile.data(), x, y, 0, 0) < 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return TIFFWriteDirectory(tif) != 0;
+}
+
+// writes level and all coarser ones into a sidecar at path, level is released as soon as it's no longer needed
+bool writePyramid(QImage level, const QString &path)
+{
+    if(level.isNull())
+    {
+        return false;
+    }
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // write to a temporary file first, so that readers never see an incomplete sidecar
+    QString tmpPath = path + QStringLiteral(".part");
+    TIFF *tif = TIFFOpen(QFile::encodeName(tmpPath).constData(), "w8");
+
+    if(tif == nullptr)
+    {
+        return false;
+    }
+
+    bool ok = true;
+
+    while(ok && !level.isNull())
+    {
+        ok = writeLevel(tif, level);
+
+        if(level.width() <= PyramidSidecar::TileSize && level.height() <= PyramidSidecar::TileSize)
+        {
+            break;
+        }
+
+        level = halve(level);
+    }
+
+    ok &= !level.isNull();
+    TIFFClose(tif);
+
+    if(!ok || !QFile::rename(tmpPath, path))
+    {
+        QFile::remove(tmpPath);
+        return false;
+    }
+
+    return true;
+}
+}
+
+struct PyramidSidecar::Impl
+{
+    TIFF *tif = nullptr;
+    std::vector<QSize> sizes;
+
+    ~Impl()
+    {
+        if(this->tif != nullptr)
+        {
+            TIFFClose(this->tif);
+        }
+    }
+};
+
+bool PyramidSidecar::isEnabled()
+{
+    return sidecarsEnabled;
+}
+
+void PyramidSidecar::setEnabled(bool enabled)
+{
+    sidecarsEnabled = enabled;
+}
+
+qint64 PyramidSidecar::cacheLimit()
+{
+    return sidecarCacheLimit;
+}
+
+void PyramidSidecar::setCacheLimit(qint64 bytes)
+{
+    sidecarCacheLimit = std::max<qint64>(bytes, 0);
+}
+
+QString PyramidSidecar::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/pyramids");
+}
+
+QString PyramidSidecar::pathFor(const QFileInfo &source)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(source.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(source.size()));
+    hash.addData(QByteArray::number(source.lastModified().toMSecsSinceEpoch()));
+
+    return cacheDirectory() + QStringLiteral("/") + QString::fromLatin1(hash.result().toHex()) + QStringLiteral(".tif");
+}
+
+void PyramidSidecar::pruneCache(const QString &dir, qint64 limit, const QString &keep)
+{
+    std::vector<QFileInfo> sidecars;
+    qint64 total = 0;
+    QDirIterator it(dir, { QStringLiteral("*.tif") }, QDir::Files);
+
+    while(it.hasNext())
+    {
+        it.next();
+        sidecars.push_back(it.fileInfo());
+        total += sidecars.back().size();
+    }
+
+    // the modification time is bumped whenever a sidecar is opened, so the oldest one is the least recently used
+    std::sort(sidecars.begin(), sidecars.end(), [](const QFileInfo &l, const QFileInfo &r)
+    {
+        return l.lastModified() < r.lastModified();
+    });
+
+    QString keepPath = keep.isEmpty() ? QString() : QFileInfo(keep).absoluteFilePath();
+
+    for(const QFileInfo &info : sidecars)
+    {
+        if(total <= limit)
+        {
+            break;
+        }
+
+        // files still open by a reader may fail to be removed on some platforms, they will be retried next time
+        if(info.absoluteFilePath() != keepPath && QFile::remove(info.absoluteFilePath()))
+        {
+            total -= info.size();
+        }
+    }
+}
+
+void PyramidSidecar::generateAsync(const QFileInfo &source, const QImage &fullRes)
+{
+    if(!isEnabled() || static_cast<qint64>(fullRes.width()) * fullRes.height() < MinPixels)
+    {
+        return;
+    }
+
+    QString path = pathFor(source);
+
+    if(QFile::exists(path))
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(inProgressMtx);
+
+        if(!inProgress.insert(path).second)
+        {
+            return;
+        }
+    }
+
+    // Computing the first level right away, rather than in the background, avoids keeping the full resolution image alive while the job
+    // is waiting in the queue. That image is invisible to DecodedImageBudget and might have been released by its Image meanwhile.
+    QImage firstLevel = halve(fullRes);
+
+    if(firstLevel.isNull())
+    {
+        std::lock_guard<std::mutex> l(inProgressMtx);
+        inProgress.erase(path);
+        return;
+    }
+
+    ANPV::globalInstance()->threadPool()->start([path, firstLevel]() mutable
+    {
+        if(!writePyramid(std::move(firstLevel), path))
+        {
+            qWarning() << "Failed to generate pyramid sidecar" << path;
+        }
+        else
+        {
+            pruneCache(QFileInfo(path).absolutePath(), cacheLimit(), path);
+        }
+
+        std::lock_guard<std::mutex> l(inProgressMtx);
+        inProgress.erase(path);
+    }, static_cast<int>(Priority::Background));
+}
+
+bool PyramidSidecar::generate(QImage fullRes, const QString &path)
+{
+    QImage level = halve(fullRes);
+    fullRes = QImage();
+    return writePyramid(std::move(level), path);
+}
+
+PyramidSidecar::PyramidSidecar(const QString &path) : d(std::make_unique<Impl>())
+{
+    if(!QFile::exists(path))
+    {
+        return;
+    }
+
+    d->tif = TIFFOpen(QFile::encodeName(path).constData(), "r");
+
+    if(d->tif == nullptr)
+    {
+        return;
+    }
+
+    {
+        // bump the modification time, so that pruneCache() treats this sidecar as recently used
+        QFile f(path);
+
+        if(f.open(QIODevice::ReadWrite))
+        {
+            f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        }
+    }
+
+    do
+    {
+        uint32_t w = 0, h = 0, tw = 0, tl = 0;
+        uint16_t spp = 0, bps = 0;
+
+        if(!TIFFGetField(d->tif, TIFFTAG_IMAGEWIDTH, &w) || !TIFFGetField(d->tif, TIFFTAG_IMAGELENGTH, &h)
+                || !TIFFGetField(d->tif, TIFFTAG_TILEWIDTH, &tw) || !TIFFGetField(d->tif, TIFFTAG_TILELENGTH, &tl)
+                || !TIFFGetField(d->tif, TIFFTAG_SAMPLESPERPIXEL, &spp) || !TIFFGetField(d->tif, TIFFTAG_BITSPERSAMPLE, &bps)
+                || tw != TileSize || tl != TileSize || spp != 4 || bps != 8)
+        {
+            // not written by us
+            d->sizes.clear();
+            break;
+        }
+
+        d->sizes.emplace_back(w, h);
+    }
+    while(TIFFReadDirectory(d->tif));
+}
+
+PyramidSidecar::~PyramidSidecar() = default;
+
+bool PyramidSidecar::isValid() const
+{
+    return !d->sizes.empty();
+}
+
+int PyramidSidecar::levels() const
+{
+    return static_cast<int>(d->sizes.size());
+}
+
+QSize PyramidSidecar::levelSize(int level) const
+{
+    return (level >= 1 && level <= this->levels()) ? d->sizes[level - 1] : QSize();
+}
+
+bool PyramidSidecar::read(int level, const QRect &pageRect, uchar *dst, qsizetype dstStride, const std::function<void(const QRect &)> &rowsRead)
+{
+    QRect r = pageRect.intersected(QRect(QPoint(0, 0), this->levelSize(level)));
+
+    if(r.isEmpty() || !TIFFSetDirectory(d->tif, level - 1))
+    {
+        return false;
+    }
+
+    std::vector<uchar> tile(TIFFTileSize(d->tif));
+
+    for(int ty = r.top() / TileSize * TileSize; ty <= r.bottom(); ty += TileSize)
+    {
+        for(int tx = r.left() / TileSize * TileSize; tx <= r.right(); tx += TileSize)
+        {
+            if(TIFFReadTile(d->tif, tile.data(), tx, ty, 0, 0) < 0)
+            {
+                return false;
+            }
+
+            QRect area = QRect(tx, ty, TileSize, TileSize).intersected(r);
+
+            for(int y = area.top(); y <= area.bottom(); y++)
+            {
+                const uchar *src = &tile[(static_cast<size_t>(y - ty) * TileSize + (area.left() - tx)) * 4];
+                uchar *out = dst + (y - pageRect.top()) * dstStride + static_cast<size_t>(area.left() - pageRect.left()) * 4;
+                std::memcpy(out, src, static_cast<size_t>(area.width()) * 4);
+            }
+        }
+
+        if(rowsRead)
+        {
+            QRect rows = QRect(r.left(), ty, r.width(), TileSize).intersected(r);
+            rowsRead(rows.translated(-pageRect.topLeft()));
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+
+#pragma once
+
+#include <QFileInfo>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <functional>
+#include <memory>
+
+/**
+ * A multi-resolution copy of a huge image, stored as tiled BigTIFF in the cache directory. The first page holds the image at half the resolution,
+ * each following one at half the resolution of its predecessor. Pixels are stored as 8 bit RGBA in sRGB, i.e. they are ready to be displayed.
+ * The file name is derived from the path, size and modification time of the source file, so that modified files never use stale sidecars.
+ */
+class PyramidSidecar
+{
+public:
+    // images with fewer pixels decode quickly enough on their own
+    static constexpr qint64 MinPixels = 64 * 1000 * 1000;
+    static constexpr int TileSize = 256;
+    static constexpr qint64 DefaultCacheLimit = 16LL * 1024 * 1024 * 1024;
+
+    // whether sidecars are generated after an image has been entirely decoded at full resolution, thread-safe
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    // the total size in bytes sidecars may occupy in the cache directory, thread-safe
+    static qint64 cacheLimit();
+    static void setCacheLimit(qint64 bytes);
+
+    static QString cacheDirectory();
+    static QString pathFor(const QFileInfo &source);
+
+    // Removes the least recently used sidecars in dir until they occupy at most limit bytes. keep is never removed.
+    static void pruneCache(const QString &dir, qint64 limit, const QString &keep = {});
+
+    // Generates the sidecar for source in the background, unless disabled, not worthwhile or already present.
+    // fullRes is the entirely decoded image. Its first level is computed synchronously, so that fullRes isn't referenced after returning.
+    // Afterwards, the cache is pruned to cacheLimit().
+    static void generateAsync(const QFileInfo &source, const QImage &fullRes);
+    // generates the sidecar synchronously, fullRes is released as soon as it's no longer needed
+    static bool generate(QImage fullRes, const QString &path);
+
+    // opening a sidecar marks it as recently used
+    explicit PyramidSidecar(const QString &path);
+    ~PyramidSidecar();
+
+    PyramidSidecar(const PyramidSidecar &) = delete;
+    PyramidSidecar &operator=(const PyramidSidecar &) = delete;
+
+    bool isValid() const;
+    // number of levels, level 1 being the one with half the resolution
+    int levels() const;
+    QSize levelSize(int level) const;
+
+    // Reads pageRect of the given level into dst, which must have room for pageRect.size() RGBA pixels.
+    // rowsRead is called with the rows of dst written so far, once per row of tiles. Returns false on error.
+    bool read(int level, const QRect &pageRect, uchar *dst, qsizetype dstStride, const std::function<void(const QRect &)> &rowsRead = {});
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
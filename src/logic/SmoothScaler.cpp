@@ -0,0 +1,183 @@
+
+#include "SmoothScaler.hpp"
+
+#include <QThread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+// the source pixels contributing to a destination pixel, and their weights
+struct Span
+{
+    int first;
+    int count;
+    size_t weights;
+};
+
+void computeSpans(int srcLen, int dstLen, std::vector<Span> &spans, std::vector<float> &weights)
+{
+    const double scale = double(srcLen) / dstLen;
+
+    spans.resize(dstLen);
+    weights.clear();
+    weights.reserve(static_cast<size_t>(dstLen) * (static_cast<size_t>(std::ceil(scale)) + 1));
+
+    for(int d = 0; d < dstLen; d++)
+    {
+        const double start = d * scale;
+        const double end = std::min<double>(srcLen, (d + 1) * scale);
+        const int first = static_cast<int>(start);
+        const int last = std::min(srcLen - 1, static_cast<int>(std::ceil(end)) - 1);
+
+        spans[d] = Span{first, last - first + 1, weights.size()};
+
+        for(int i = first; i <= last; i++)
+        {
+            double coverage = std::min<double>(end, i + 1) - std::max<double>(start, i);
+            weights.push_back(static_cast<float>(coverage / (end - start)));
+        }
+    }
+}
+}
+
+bool SmoothScaler::areaAverage(const uchar *src, qsizetype srcStride, int srcWidth, int srcHeight,
+                               uchar *dst, qsizetype dstStride, int dstWidth, int dstHeight, const std::function<bool()> &isCancelled, int maxThreads)
+{
+    std::vector<Span> xSpans, ySpans;
+    std::vector<float> xWeights, yWeights;
+    computeSpans(srcWidth, dstWidth, xSpans, xWeights);
+    computeSpans(srcHeight, dstHeight, ySpans, yWeights);
+
+    const size_t rowLen = static_cast<size_t>(srcWidth) * 4;
+    std::atomic<bool> cancelled = false;
+
+#ifdef _OPENMP
+    const int threads = maxThreads > 0 ? std::min(maxThreads, omp_get_max_threads()) : omp_get_max_threads();
+#else
+    Q_UNUSED(maxThreads)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(threads)
+#endif
+    {
+        // the vertically averaged source rows belonging to the current destination row
+        std::vector<float> acc(rowLen);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic, 8)
+#endif
+
+        for(int y = 0; y < dstHeight; y++)
+        {
+            if(cancelled.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            if(isCancelled && isCancelled())
+            {
+                cancelled = true;
+                continue;
+            }
+
+            const Span &ys = ySpans[y];
+            std::fill(acc.begin(), acc.end(), 0.0f);
+
+            for(int k = 0; k < ys.count; k++)
+            {
+                const uchar *in = src + (ys.first + k) * srcStride;
+                const float w = yWeights[ys.weights + k];
+                float *a = acc.data();
+
+                // simple enough to be vectorized by the compiler
+                for(size_t i = 0; i < rowLen; i++)
+                {
+                    a[i] += w * in[i];
+                }
+            }
+
+            uchar *out = dst + y * dstStride;
+
+            for(int x = 0; x < dstWidth; x++)
+            {
+                const Span &xs = xSpans[x];
+                float c[4] = {0, 0, 0, 0};
+
+                for(int k = 0; k < xs.count; k++)
+                {
+                    const float w = xWeights[xs.weights + k];
+                    const float *a = &acc[static_cast<size_t>(xs.first + k) * 4];
+                    c[0] += w * a[0];
+                    c[1] += w * a[1];
+                    c[2] += w * a[2];
+                    c[3] += w * a[3];
+                }
+
+                for(int i = 0; i < 4; i++)
+                {
+                    out[x * 4 + i] = static_cast<uchar>(std::min(255.0f, c[i] + 0.5f));
+                }
+            }
+        }
+    }
+
+    return !cancelled;
+}
+
+QImage SmoothScaler::areaAverage(const QImage &src, const QRect &srcRect, QSize dstSize, const std::function<bool()> &isCancelled, int maxThreads)
+{
+    QRect r = srcRect.intersected(src.rect());
+
+    if(r.isEmpty() || dstSize.isEmpty())
+    {
+        return QImage();
+    }
+
+    dstSize = dstSize.boundedTo(r.size());
+
+    QImage in = src;
+
+    switch(src.format())
+    {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        // averaging is independent of the channel order, but requires premultiplied alpha
+        break;
+
+    default:
+        in = src.copy(r).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        r.moveTopLeft(QPoint(0, 0));
+        break;
+    }
+
+    QImage out(dstSize, in.format());
+
+    if(out.isNull())
+    {
+        return QImage();
+    }
+
+    const uchar *first = in.constScanLine(r.top()) + static_cast<size_t>(r.left()) * 4;
+
+    if(!areaAverage(first, in.bytesPerLine(), r.width(), r.height(), out.bits(), out.bytesPerLine(), out.width(), out.height(), isCancelled, maxThreads))
+    {
+        return QImage();
+    }
+
+    return out;
+}
+
+int SmoothScaler::threadsPerWorker(const QThreadPool *pool)
+{
+    return std::max(1, QThread::idealThreadCount() / std::max(1, pool->maxThreadCount()));
+}
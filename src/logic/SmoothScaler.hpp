@@ -0,0 +1,29 @@
+
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QThreadPool>
+#include <functional>
+
+/**
+ * High quality downscaling of 32 bit images without the need of a GPU, usable from any thread.
+ */
+class SmoothScaler
+{
+public:
+    SmoothScaler() = delete;
+
+    // Downscales the srcRect of src to dstSize by averaging all source pixels covered by a destination pixel, weighted by their coverage.
+    // Rows are processed in parallel by up to maxThreads threads, 0 meaning as many as OpenMP sees fit.
+    // isCancelled may be called concurrently by multiple threads; once it returns true, a null image is returned.
+    static QImage areaAverage(const QImage &src, const QRect &srcRect, QSize dstSize, const std::function<bool()> &isCancelled = {}, int maxThreads = 0);
+
+    // The raw implementation of areaAverage() working on four 8 bit channels per pixel. Returns false if cancelled.
+    static bool areaAverage(const uchar *src, qsizetype srcStride, int srcWidth, int srcHeight,
+                            uchar *dst, qsizetype dstStride, int dstWidth, int dstHeight, const std::function<bool()> &isCancelled, int maxThreads = 0);
+
+    // The number of threads each worker of pool may use without oversubscribing the CPU while all workers are busy.
+    static int threadsPerWorker(const QThreadPool *pool);
+};
@@ -0,0 +1,330 @@
+
+#include "TileCache.hpp"
+
+#include <QPainter>
+#include <QtDebug>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+// When checking whether a tile can be satisfied by finer levels, only look this many levels down, as the number of tiles to check grows by 4 each level.
+constexpr int MaxFinerLevelsToCheck = 2;
+
+struct TileCache::Impl
+{
+    struct Entry
+    {
+        QImage tile;
+        std::list<quint64>::iterator lru;
+    };
+
+    QRect fullResRect;
+    qint64 budget;
+    qint64 used = 0;
+    // the level at which the entire image fits into a single tile
+    int maxLevel = 0;
+
+    // most recently used tiles at the front
+    std::list<quint64> lru;
+    std::unordered_map<quint64, Entry> tiles;
+
+    Impl(const QRect &r, qint64 budget) : fullResRect(r), budget(budget)
+    {
+        int extent = std::max(r.width(), r.height());
+
+        while((TileSize << this->maxLevel) < extent)
+        {
+            this->maxLevel++;
+        }
+    }
+
+    static quint64 key(int level, int tx, int ty)
+    {
+        return (static_cast<quint64>(level) << 56) | (static_cast<quint64>(tx) << 28) | static_cast<quint64>(ty);
+    }
+
+    static int extent(int level)
+    {
+        return TileSize << level;
+    }
+
+    // the part of the image covered by the given tile, in full resolution coordinates
+    QRect tileRect(int level, int tx, int ty) const
+    {
+        int ext = extent(level);
+        return QRect(this->fullResRect.x() + tx * ext, this->fullResRect.y() + ty * ext, ext, ext).intersected(this->fullResRect);
+    }
+
+    // the size in pixels of the given full resolution rect at the given level
+    static QSize levelSize(const QRect &r, int level)
+    {
+        int div = 1 << level;
+        return QSize((r.width() + div - 1) / div, (r.height() + div - 1) / div);
+    }
+
+    // the range of tiles intersecting r, or false if there are none
+    bool tileRange(const QRect &r, int level, int &x0, int &y0, int &x1, int &y1) const
+    {
+        QRect clipped = r.intersected(this->fullResRect);
+
+        if(clipped.isEmpty())
+        {
+            return false;
+        }
+
+        int ext = extent(level);
+        clipped.translate(-this->fullResRect.topLeft());
+        x0 = clipped.left() / ext;
+        y0 = clipped.top() / ext;
+        x1 = clipped.right() / ext;
+        y1 = clipped.bottom() / ext;
+        return true;
+    }
+
+    const QImage *find(int level, int tx, int ty)
+    {
+        auto it = this->tiles.find(key(level, tx, ty));
+
+        if(it == this->tiles.end())
+        {
+            return nullptr;
+        }
+
+        this->lru.splice(this->lru.begin(), this->lru, it->second.lru);
+        return &it->second.tile;
+    }
+
+    void store(quint64 k, QImage &&tile)
+    {
+        this->used += tile.sizeInBytes();
+        this->lru.push_front(k);
+        this->tiles.emplace(k, Entry{std::move(tile), this->lru.begin()});
+    }
+
+    void evict()
+    {
+        while(this->used > this->budget && !this->lru.empty())
+        {
+            auto it = this->tiles.find(this->lru.back());
+            this->used -= it->second.tile.sizeInBytes();
+            this->tiles.erase(it);
+            this->lru.pop_back();
+        }
+    }
+
+    // whether the given tile is available, either directly or entirely made up of tiles of the next finer levels
+    bool isAvailable(int level, int tx, int ty, int finerLevelsToCheck)
+    {
+        if(this->find(level, tx, ty) != nullptr)
+        {
+            return true;
+        }
+
+        if(level == 0 || finerLevelsToCheck == 0)
+        {
+            return false;
+        }
+
+        int x0, y0, x1, y1;
+        this->tileRange(this->tileRect(level, tx, ty), level - 1, x0, y0, x1, y1);
+
+        for(int y = y0; y <= y1; y++)
+        {
+            for(int x = x0; x <= x1; x++)
+            {
+                if(!this->isAvailable(level - 1, x, y, finerLevelsToCheck - 1))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // paints the given tile at its full resolution rect, falling back to finer levels
+    void paintTile(QPainter &p, int level, int tx, int ty, int finerLevelsToCheck)
+    {
+        QRect tr = this->tileRect(level, tx, ty);
+        const QImage *tile = this->find(level, tx, ty);
+
+        if(tile != nullptr)
+        {
+            p.drawImage(tr, *tile);
+            return;
+        }
+
+        if(level == 0 || finerLevelsToCheck == 0)
+        {
+            return;
+        }
+
+        int x0, y0, x1, y1;
+        this->tileRange(tr, level - 1, x0, y0, x1, y1);
+
+        for(int y = y0; y <= y1; y++)
+        {
+            for(int x = x0; x <= x1; x++)
+            {
+                this->paintTile(p, level - 1, x, y, finerLevelsToCheck - 1);
+            }
+        }
+    }
+};
+
+TileCache::TileCache(const QRect &fullResRect, qint64 budgetBytes) : d(std::make_unique<Impl>(fullResRect, budgetBytes))
+{
+}
+
+TileCache::~TileCache() = default;
+
+QRect TileCache::fullResolutionRect() const
+{
+    return d->fullResRect;
+}
+
+qint64 TileCache::sizeInBytes() const
+{
+    return d->used;
+}
+
+void TileCache::clear()
+{
+    d->tiles.clear();
+    d->lru.clear();
+    d->used = 0;
+}
+
+int TileCache::levelForScale(double scale)
+{
+    if(!(scale > 0) || scale >= 1.0)
+    {
+        return 0;
+    }
+
+    // a tiny epsilon avoids ending up one level too fine due to rounding errors, e.g. when scale is exactly 0.5
+    return static_cast<int>(std::floor(std::log2(1.0 / scale) + 1e-6));
+}
+
+void TileCache::insert(const QImage &img, const QTransform &pageToFullRes)
+{
+    if(img.isNull())
+    {
+        return;
+    }
+
+    // one pixel of img covers that many pixels of the full resolution image
+    double pageScale = std::max(std::abs(pageToFullRes.m11()), std::abs(pageToFullRes.m22()));
+
+    if(!(pageScale > 0))
+    {
+        return;
+    }
+
+    // store into the finest level, which is not finer than img, i.e. tiles are only ever scaled down
+    int level = std::max(0, static_cast<int>(std::ceil(std::log2(pageScale) - 1e-3)));
+
+    if(level > d->maxLevel)
+    {
+        // too coarse to be of any use
+        return;
+    }
+
+    QRectF covered = pageToFullRes.mapRect(QRectF(QPointF(0, 0), img.size())).translated(img.offset());
+    // tolerate rounding errors of up to one pixel of img
+    QRectF tolerated = covered.adjusted(-pageScale, -pageScale, pageScale, pageScale);
+
+    int x0, y0, x1, y1;
+
+    if(!d->tileRange(covered.toAlignedRect(), level, x0, y0, x1, y1))
+    {
+        return;
+    }
+
+    QTransform fullResToPage = pageToFullRes.inverted();
+
+    for(int y = y0; y <= y1; y++)
+    {
+        for(int x = x0; x <= x1; x++)
+        {
+            QRect tr = d->tileRect(level, x, y);
+            quint64 k = Impl::key(level, x, y);
+
+            if(!tolerated.contains(QRectF(tr)) || d->tiles.count(k) != 0)
+            {
+                continue;
+            }
+
+            QSize tileSize = Impl::levelSize(tr, level);
+            QRectF source = fullResToPage.mapRect(QRectF(tr).translated(-img.offset()));
+            QImage tile;
+
+            if(source.size().toSize() == tileSize && source.topLeft() == source.topLeft().toPoint())
+            {
+                // pixel exact, no need for resampling
+                tile = img.copy(QRect(source.topLeft().toPoint(), tileSize)).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            }
+            else
+            {
+                tile = QImage(tileSize, QImage::Format_ARGB32_Premultiplied);
+                tile.fill(Qt::transparent);
+                QPainter p(&tile);
+                p.setRenderHint(QPainter::SmoothPixmapTransform);
+                p.drawImage(QRectF(QPointF(0, 0), tileSize), img, source);
+            }
+
+            tile.setOffset(QPoint());
+            d->store(k, std::move(tile));
+        }
+    }
+
+    d->evict();
+}
+
+QRect TileCache::missingRect(const QRect &fullResRect, int level)
+{
+    level = std::clamp(level, 0, d->maxLevel);
+
+    int x0, y0, x1, y1;
+
+    if(!d->tileRange(fullResRect, level, x0, y0, x1, y1))
+    {
+        return QRect();
+    }
+
+    QRect missing;
+
+    for(int y = y0; y <= y1; y++)
+    {
+        for(int x = x0; x <= x1; x++)
+        {
+            if(!d->isAvailable(level, x, y, MaxFinerLevelsToCheck))
+            {
+                missing = missing.united(d->tileRect(level, x, y));
+            }
+        }
+    }
+
+    return missing;
+}
+
+void TileCache::paint(QPainter &p, const QRect &fullResRect, int level)
+{
+    level = std::clamp(level, 0, d->maxLevel);
+
+    int x0, y0, x1, y1;
+
+    if(!d->tileRange(fullResRect, level, x0, y0, x1, y1))
+    {
+        return;
+    }
+
+    for(int y = y0; y <= y1; y++)
+    {
+        for(int x = x0; x <= x1; x++)
+        {
+            d->paintTile(p, level, x, y, MaxFinerLevelsToCheck);
+        }
+    }
+}
@@ -0,0 +1,49 @@
+
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QTransform>
+#include <memory>
+
+class QPainter;
+
+/**
+ * A per-image pyramid of fixed-size tiles at power-of-two scales, kept within a memory budget by evicting the least recently used tiles.
+ * Level 0 holds tiles in full resolution, level 1 in half resolution, and so on. All rects passed in and out are in full resolution coordinates.
+ * Not thread-safe, only to be used by the thread owning the view.
+ */
+class TileCache
+{
+public:
+    // edge length of a tile in pixels of its level
+    static constexpr int TileSize = 256;
+
+    TileCache(const QRect &fullResRect, qint64 budgetBytes);
+    ~TileCache();
+
+    TileCache(const TileCache &) = delete;
+    TileCache &operator=(const TileCache &) = delete;
+
+    QRect fullResolutionRect() const;
+    qint64 sizeInBytes() const;
+    void clear();
+
+    // the coarsest level that still provides at least the given number of device pixels per full resolution pixel
+    static int levelForScale(double scale);
+
+    // Splits a decoded image into tiles. pageToFullRes is the transform that maps pixels of img to full resolution pixels,
+    // and img.offset() is its top left corner in full resolution coordinates. Only tiles entirely covered by img are stored.
+    void insert(const QImage &img, const QTransform &pageToFullRes);
+
+    // The bounding rect of all tiles intersecting fullResRect that are neither available at the given level nor at any finer one.
+    // Returns an empty rect if everything is available.
+    QRect missingRect(const QRect &fullResRect, int level);
+
+    // Paints all available tiles intersecting fullResRect directly onto p, whose coordinate system must be in full resolution coordinates.
+    void paint(QPainter &p, const QRect &fullResRect, int level);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
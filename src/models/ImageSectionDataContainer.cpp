@@ -17,8 +17,11 @@
 #include <QApplication>
 #include <QPersistentModelIndex>
 #include <QFutureWatcher>
+#include <QLocale>
 
 #include <mutex>
+#include <exception>
+#include <map>
 
 struct ImageSectionDataContainer::Impl
 {
@@ -72,6 +75,239 @@ struct ImageSectionDataContainer::Impl
         return upper;
     }
 
+    // The file sizes are grouped into sections of doubling size, starting with everything below this one.
+    static constexpr qint64 SmallestFileSizeSection = 1024 * 1024;
+
+    // Computes the section an image with decoder belongs to, according to the current sectionSortField.
+    // EXIF based sections rely on the metadata having been loaded already, images without go into the unnamed section.
+    QVariant sectionKey(const QSharedPointer<Image> &image)
+    {
+        QVariant var;
+        QString str;
+
+        switch(this->sectionSortField)
+        {
+        case SortField::DateModified:
+            var = image->fileInfo().lastModified().date();
+            break;
+
+        case SortField::FileName:
+            str = image->getName();
+
+            if(str[0].isDigit())
+            {
+                str = QStringLiteral("#");
+            }
+            else
+            {
+                str = str.left(1).toUpper();
+            }
+
+            var = str;
+            break;
+
+        case SortField::FileType:
+            var = image->fileInfo().suffix().toUpper();
+            break;
+
+        case SortField::FileSize:
+        {
+            // the upper bound of the section
+            qint64 bound = SmallestFileSizeSection;
+
+            while(bound <= image->fileInfo().size())
+            {
+                bound *= 2;
+            }
+
+            var = bound;
+            break;
+        }
+
+        case SortField::None:
+        case SortField::Last:
+            break;
+
+        default:
+        {
+            auto exif = image->exif();
+
+            if(!exif.isNull())
+            {
+                const ExifSummary &sum = exif->summary();
+
+                switch(this->sectionSortField)
+                {
+                case SortField::DateRecorded:
+                    if(sum.dateRecorded.isValid())
+                    {
+                        var = sum.dateRecorded.date();
+                    }
+
+                    break;
+
+                case SortField::Aperture:
+                    if(sum.hasAperture())
+                    {
+                        var = sum.aperture;
+                    }
+
+                    break;
+
+                case SortField::Exposure:
+                    var = ExifWrapper::formatExposureTime(sum.exposureNum, sum.exposureDen);
+                    break;
+
+                case SortField::Iso:
+                    if(sum.hasIso())
+                    {
+                        var = qlonglong(sum.iso);
+                    }
+
+                    break;
+
+                case SortField::FocalLength:
+                    var = sum.hasFocalLength() ? QStringLiteral("%1 mm").arg(QString::number(sum.focalLength)) : QString();
+                    break;
+
+                case SortField::Lens:
+                    var = sum.lens;
+                    break;
+
+                case SortField::CameraModel:
+                    if(!sum.cameraModel.isEmpty())
+                    {
+                        var = sum.cameraModel;
+                    }
+
+                    break;
+
+                case SortField::Resolution:
+                {
+                    QSize size = image->size();
+
+                    if(size.isValid())
+                    {
+                        var = size;
+                    }
+
+                    break;
+                }
+
+                default:
+                    break;
+                }
+            }
+
+            break;
+        }
+        }
+
+        return var;
+    }
+
+    // Creates an empty section for the given key, named according to the current sectionSortField.
+    SectionList::value_type makeSection(const QVariant &var)
+    {
+        SectionList::value_type section(new SectionItem(var, this->imageSortField, this->imageSortOrder));
+
+        if(this->sectionSortField == SortField::FileSize && var.isValid())
+        {
+            qint64 bound = var.toLongLong();
+            QLocale locale;
+
+            if(bound == SmallestFileSizeSection)
+            {
+                section->setName(QStringLiteral("< %1").arg(locale.formattedDataSize(bound, 0)));
+            }
+            else
+            {
+                section->setName(QStringLiteral("%1 - %2").arg(locale.formattedDataSize(bound / 2, 0), locale.formattedDataSize(bound, 0)));
+            }
+        }
+
+        return section;
+    }
+
+    // Sorts the images of all sections concurrently. SectionItem::sortItems() further splits large sections into tasks.
+    void sortImagesOfAllSections(SortField field, Qt::SortOrder order)
+    {
+        // Exceptions must not escape an OpenMP task, so rethrow the first one afterwards.
+        std::exception_ptr ex;
+        const size_t sectionCount = this->data.size();
+
+#ifdef _OPENMP
+        #pragma omp parallel
+        #pragma omp single
+#endif
+        for(size_t i = 0; i < sectionCount; i++)
+        {
+#ifdef _OPENMP
+            #pragma omp task firstprivate(i) shared(ex)
+#endif
+            {
+                try
+                {
+                    this->data[i]->sortItems(field, order);
+                }
+                catch(...)
+                {
+#ifdef _OPENMP
+                    #pragma omp critical
+#endif
+                    {
+                        if(!ex)
+                        {
+                            ex = std::current_exception();
+                        }
+                    }
+                }
+            }
+        }
+
+        if(ex)
+        {
+            std::rethrow_exception(ex);
+        }
+    }
+
+    // Moves all images into newly created sections according to the current sectionSortField, using cached metadata only.
+    void regroupSections()
+    {
+        // QVariant is not hashable, so key the sections by type and string representation
+        std::map<QString, SectionList::value_type> sectionByKey;
+        SectionList regrouped;
+
+        for(const auto &section : this->data)
+        {
+            for(size_t i = 0; i < section->size(); i++)
+            {
+                auto image = AbstractListItem::imageCast(section->at(i));
+                QVariant var = image->hasDecoder() ? this->sectionKey(image) : QVariant();
+
+                auto &newSection = sectionByKey[QString::number(var.typeId()) + QLatin1Char(':') + var.toString()];
+
+                if(!newSection)
+                {
+                    newSection = this->makeSection(var);
+                    regrouped.push_back(newSection);
+                }
+
+                newSection->append(image);
+            }
+        }
+
+        this->data.clear();
+        this->data.reserve(regrouped.size());
+
+        for(auto &section : regrouped)
+        {
+            this->data.insert(this->findInsertPosition(section), section);
+        }
+
+        this->sortImagesOfAllSections(this->imageSortField, this->imageSortOrder);
+    }
+
     std::list<QSharedPointer<AbstractListItem>> flatListForUI()
     {
         std::list<QSharedPointer<AbstractListItem>> result;
@@ -225,97 +461,9 @@ QSharedPointer<Image> ImageSectionDataContainer::addImageItem(const QFileInfo& i
                 }
             }
 
-            QString str;
-
-            switch(d->sectionSortField)
-            {
-            case SortField::DateModified:
-                var = info.lastModified().date();
-                break;
-
-            case SortField::FileName:
-                str = image->getName();
-
-                if(str[0].isDigit())
-                {
-                    str = QStringLiteral("#");
-                }
-                else
-                {
-                    str = str.left(1).toUpper();
-                }
-
-                var = str;
-                break;
-
-            case SortField::FileType:
-                var = info.suffix().toUpper();
-                break;
-
-            case SortField::None:
-                break;
-
-            default:
-            {
-                double f;
-                int64_t l;
-                QDateTime dt;
-                auto exif = image->exif();
-
-                if(!exif.isNull())
-                {
-                    switch(d->sectionSortField)
-                    {
-                    case SortField::DateRecorded:
-                        dt = exif->dateRecorded();
-
-                        if(dt.isValid())
-                        {
-                            var = dt.date();
-                        }
-
-                        break;
-
-                    case SortField::Aperture:
-                        if(exif->aperture(f))
-                        {
-                            var = f;
-                        }
-
-                        break;
-
-                    case SortField::Exposure:
-                        var = exif->exposureTime();
-                        break;
-
-                    case SortField::Iso:
-                        if(exif->iso(l))
-                        {
-                            var = qlonglong(l);
-                        }
-
-                        break;
-
-                    case SortField::FocalLength:
-                        var = exif->focalLength();
-                        break;
-
-                    case SortField::Lens:
-                        var = exif->lens();
-                        break;
-
-                    case SortField::CameraModel:
-                        throw std::logic_error("ItemImageCameraModel not yet implemented");
-
-                    default:
-                        throw std::logic_error("requested section sort type not yet implemented");
-                    }
-                }
-
-                break;
-            }
-            }
-
+            // if the metadata arrives in between, updateSectionOfImage() must either see the image or sectionKey() must see the metadata
+            std::lock_guard<std::recursive_mutex> l(d->m);
+            var = d->sectionKey(image);
             this->addImageItem(var, image);
         }
         catch(const std::runtime_error &e)
@@ -360,7 +508,7 @@ void ImageSectionDataContainer::addImageItem(const QVariant &section, QSharedPoi
     {
         // no suitable section found, create a new one
         insertIdx = 0;
-        auto s = SectionList::value_type(new SectionItem(section, d->imageSortField, d->imageSortOrder));
+        auto s = d->makeSection(section);
         auto sectionInsertPos = d->findInsertPosition(s);
 
         for(auto sit = this->d->data.begin(); sit != sectionInsertPos; ++sit)
@@ -443,6 +591,39 @@ bool ImageSectionDataContainer::removeImageItem(const QFileInfo &info)
     return false;
 }
 
+/* Moves the image (img) into the section it belongs to now. This is necessary if its metadata was not available yet when the sections were
+   created, e.g. because the sections were regrouped while the directory was still loading. */
+void ImageSectionDataContainer::updateSectionOfImage(const Image *img)
+{
+    std::lock_guard<std::recursive_mutex> l(d->m);
+
+    if(!this->sortedColumnNeedsPreloadingMetadata(d->sectionSortField, SortField::None))
+    {
+        // the section doesn't depend on any metadata
+        return;
+    }
+
+    for(const auto &section : d->data)
+    {
+        int idx = 0;
+
+        if(section->find(img, &idx))
+        {
+            auto image = AbstractListItem::imageCast(section->at(idx));
+            QVariant var = image->hasDecoder() ? d->sectionKey(image) : QVariant();
+
+            if(section.data() != var)
+            {
+                // section is dangling afterwards
+                this->removeImageItem(image->fileInfo());
+                this->addImageItem(var, image);
+            }
+
+            return;
+        }
+    }
+}
+
 /* Return the item of a given index (index). The 2D data list are handled like a 1D list. */
 QSharedPointer<AbstractListItem> ImageSectionDataContainer::getItemByLinearIndex(int index) const
 {
@@ -601,42 +782,28 @@ void ImageSectionDataContainer::sortImageItems(SortField imageSortField, Qt::Sor
         return;
     }
 
-    if(d->model)
-    {
-        QMetaObject::invokeMethod(d->model, [rowCount, this]()
-        {
-            d->model->removeRows(0, rowCount);
-        }, Qt::AutoConnection);
-    }
-
-    for(auto it = this->d->data.begin(); it != this->d->data.end(); ++it)
-    {
-        (*it)->sortItems(imageSortField, order);
-    }
+    d->sortImagesOfAllSections(imageSortField, order);
 
     if(d->model)
     {
+        // only permute the rows of the model rather than removing and reinserting all of them, to keep selection, scroll position and background tasks
         auto itemsForUIModel = d->flatListForUI();
         QMetaObject::invokeMethod(d->model, [itemsForUIModel, this]()
         {
-            auto copy = itemsForUIModel;
-            d->model->insertRows(0, copy);
-            Q_ASSERT(copy.empty());
+            d->model->reorderRows(itemsForUIModel);
         }, Qt::AutoConnection);
     }
 }
 
-/* Sorts the section item according to given the order (order). */
+/* Sorts the section item according to given the order (order). If the field (sectionSortField) has changed, all images are regrouped into new sections. */
 void ImageSectionDataContainer::sortSections(SortField sectionSortField, Qt::SortOrder order)
 {
     std::lock_guard<std::recursive_mutex> l(d->m);
 
+    bool fieldChanged = d->sectionSortField != sectionSortField;
     d->sectionSortOrder = order;
     d->sectionSortField = sectionSortField;
 
-    // the code below is incomplete...
-    return;
-
     auto rowCount = this->size();
 
     if(rowCount == 0)
@@ -644,26 +811,37 @@ void ImageSectionDataContainer::sortSections(SortField sectionSortField, Qt::Sor
         return;
     }
 
-    if(d->model)
+    if(fieldChanged)
     {
-        QMetaObject::invokeMethod(d->model, [rowCount, this]()
-        {
-            d->model->removeRows(0, rowCount);
-        }, Qt::AutoConnection);
+        d->regroupSections();
     }
+    else
+    {
+        // The section comparator is not a strict weak ordering (unnamed sections always go first), so std::sort cannot be used here.
+        // Reinsert the sections one by one instead, exactly like addImageItem() does.
+        SectionList sections;
+        sections.swap(d->data);
 
-    std::sort(this->d->data.begin(), this->d->data.end(), d->getSortFunction(order));
-
-    // ...because it is missing recreation of all section items here
+        for(auto &section : sections)
+        {
+            d->data.insert(d->findInsertPosition(section), section);
+        }
+    }
 
     if(d->model)
     {
         auto itemsForUIModel = d->flatListForUI();
-        QMetaObject::invokeMethod(d->model, [itemsForUIModel, this]()
+        QMetaObject::invokeMethod(d->model, [itemsForUIModel, fieldChanged, this]()
         {
-            auto copy = itemsForUIModel;
-            d->model->insertRows(0, copy);
-            Q_ASSERT(copy.empty());
+            if(fieldChanged)
+            {
+                d->model->resetRows(itemsForUIModel);
+            }
+            else
+            {
+                // the sections are still the same, so only permute them to keep selection and scroll position
+                d->model->reorderRows(itemsForUIModel);
+            }
         }, Qt::AutoConnection);
     }
 }
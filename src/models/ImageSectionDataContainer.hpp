@@ -57,6 +57,7 @@ public:
     QSharedPointer<Image> addImageItem(const QFileInfo &info);
     void addImageItem(const QVariant &section, QSharedPointer<Image> &item);
     bool removeImageItem(const QFileInfo &info);
+    void updateSectionOfImage(const Image *img);
 
     QSharedPointer<AbstractListItem> getItemByLinearIndex(int idx) const;
     int getLinearIndexOfItem(const AbstractListItem *item) const;
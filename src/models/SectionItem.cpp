@@ -11,6 +11,10 @@
 #include "ExifWrapper.hpp"
 #include "ImageSectionDataContainer.hpp"
 
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
 #ifdef _WINDOWS
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
@@ -29,300 +33,262 @@ struct SectionItem::Impl
     SortField imageSortField = SortField::None;
     Qt::SortOrder imageSortOrder = Qt::DescendingOrder;
 
-    static bool compareFileName(const QFileInfo &linfo, const QFileInfo &rinfo)
+    // overrides the name derived from the item id, if not empty
+    QString name;
+
+    // compares two item ids of the same type
+    static bool idLessThan(const QVariant &l, const QVariant &r)
     {
+        switch(l.typeId())
+        {
+        case QMetaType::QDate:
+            return l.toDate() < r.toDate();
+
+        case QMetaType::QSize:
+        {
+            QSize ls = l.toSize();
+            QSize rs = r.toSize();
+            qint64 la = static_cast<qint64>(ls.width()) * ls.height();
+            qint64 ra = static_cast<qint64>(rs.width()) * rs.height();
+            return la != ra ? la < ra : ls.width() < rs.width();
+        }
+
+        case QMetaType::Int:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+        case QMetaType::Double:
+            return l.toDouble() < r.toDouble();
+
+        default:
+            return l.toString() < r.toString();
+        }
+    }
+
+    // A flat copy of everything the sort predicate needs to know about an Image. It is computed once per Image
+    // and sort run, so that comparisons neither allocate nor need to lock the Image to query its EXIF data.
+    struct SortKey
+    {
+        // the case folded file name, used for natural order comparison
 #ifdef _WINDOWS
-        std::wstring l = linfo.fileName().toCaseFolded().toStdWString();
-        std::wstring r = rinfo.fileName().toCaseFolded().toStdWString();
-        return StrCmpLogicalW(l.c_str(), r.c_str()) < 0;
+        std::wstring name;
 #else
-        QByteArray lfile = linfo.fileName().toCaseFolded().toUtf8();
-        QByteArray rfile = rinfo.fileName().toCaseFolded().toUtf8();
-        return strverscmp(lfile.constData(), rfile.constData()) < 0;
+        QByteArray name;
 #endif
+        // the primary sort criterion, which is either numeric or a string
+        QString str;
+        double num = 0;
+        // 0: the primary criterion is available, 1: EXIF is available but the criterion is not, 2: no EXIF at all
+        quint8 rank = 0;
+        bool isDir = false;
+        // position of the Image in the ImageList before sorting
+        uint32_t index = 0;
+    };
+
+    static void fillExifSortKey(SortField field, const QSharedPointer<Image> &img, SortKey &key)
+    {
+        auto exif = img->exif();
+
+        if(!exif)
+        {
+            key.rank = 2;
+            return;
+        }
+
+        const ExifSummary &sum = exif->summary();
+        bool valid;
+
+        switch(field)
+        {
+        case SortField::DateRecorded:
+            valid = sum.dateRecorded.isValid();
+            key.num = valid ? sum.dateRecorded.toMSecsSinceEpoch() : 0;
+            break;
+
+        case SortField::Resolution:
+        {
+            QSize size = img->size();
+            valid = size.isValid();
+            key.num = valid ? static_cast<double>(size.width()) * size.height() : 0;
+            break;
+        }
+
+        case SortField::Aperture:
+            valid = sum.hasAperture();
+            key.num = sum.aperture;
+            break;
+
+        case SortField::Exposure:
+            valid = sum.hasExposureTime();
+            key.num = sum.exposureTime;
+            break;
+
+        case SortField::Iso:
+            valid = sum.hasIso();
+            key.num = static_cast<double>(sum.iso);
+            break;
+
+        case SortField::FocalLength:
+            valid = sum.hasFocalLength();
+            key.num = sum.focalLength;
+            break;
+
+        case SortField::Lens:
+            valid = !sum.lens.isEmpty();
+            key.str = sum.lens;
+            break;
+
+        case SortField::CameraModel:
+            valid = !sum.cameraModel.isEmpty();
+            key.str = sum.cameraModel;
+            break;
+
+        default:
+            throw std::logic_error(Formatter() << "No sorting function implemented for SortField " << (int)field);
+        }
+
+        key.rank = valid ? 0 : 1;
     }
 
-    template<SortField SortCol>
-    static bool sortColumnPredicateLeftBeforeRight(const QSharedPointer<Image> &limg, const QFileInfo &linfo, const QSharedPointer<Image> &rimg, const QFileInfo &rinfo)
+    static SortKey makeSortKey(SortField field, const QSharedPointer<Image> &img, uint32_t index = 0)
     {
-        if constexpr(SortCol == SortField::FileName)
+        const QFileInfo &info = img->fileInfo();
+
+        SortKey key;
+        key.index = index;
+        key.isDir = info.isDir();
+#ifdef _WINDOWS
+        key.name = info.fileName().toCaseFolded().toStdWString();
+#else
+        key.name = info.fileName().toCaseFolded().toUtf8();
+#endif
+
+        if(key.isDir)
         {
-            // nothing to do here, we use the fileName comparison below
+            // directories are always sorted by name
+            return key;
         }
-        else if constexpr(SortCol == SortField::FileSize)
+
+        switch(field)
         {
-            return linfo.size() < rinfo.size();
+        case SortField::FileName:
+            // nothing to do here, we use the fileName comparison anyway
+            break;
+
+        case SortField::FileSize:
+            key.num = info.size();
+            break;
+
+        case SortField::FileType:
+            key.str = info.suffix().toUpper();
+            break;
+
+        case SortField::DateModified:
+            key.num = info.lastModified().toMSecsSinceEpoch();
+            break;
+
+        default:
+            fillExifSortKey(field, img, key);
+            break;
         }
-        else if constexpr(SortCol == SortField::FileType)
+
+        return key;
+    }
+
+    static bool compareFileName(const SortKey &l, const SortKey &r)
+    {
+#ifdef _WINDOWS
+        return StrCmpLogicalW(l.name.c_str(), r.name.c_str()) < 0;
+#else
+        return strverscmp(l.name.constData(), r.name.constData()) < 0;
+#endif
+    }
+
+    // Compares two regular files in ascending order. Images with the sort criterion available come first,
+    // then those having EXIF data, then all remaining ones. Ties are resolved by file name.
+    static bool sortKeyLeftBeforeRight(const SortKey &l, const SortKey &r)
+    {
+        if(l.rank != r.rank)
         {
-            return linfo.suffix().toUpper() < rinfo.suffix().toUpper();
+            return l.rank < r.rank;
         }
-        else if constexpr(SortCol == SortField::DateModified)
+
+        if(l.num != r.num)
         {
-            return linfo.lastModified() < rinfo.lastModified();
+            return l.num < r.num;
         }
 
-        bool leftFileNameIsBeforeRight = compareFileName(linfo, rinfo);
-
-        if constexpr(ImageSectionDataContainer::sortedColumnNeedsPreloadingMetadata(SortCol, SortCol))
+        if(l.str != r.str)
         {
-            // only evaluate exif() when sortedColumnNeedsPreloadingMetadata() is true!
-            auto lexif = limg->exif();
-            auto rexif = rimg->exif();
-
-            if(lexif && rexif)
-            {
-                if constexpr(SortCol == SortField::DateRecorded)
-                {
-                    QDateTime ltime = lexif->dateRecorded();
-                    QDateTime rtime = rexif->dateRecorded();
-
-                    if(ltime.isValid() && rtime.isValid())
-                    {
-                        if(ltime != rtime)
-                        {
-                            return ltime < rtime;
-                        }
-                    }
-                    else if(ltime.isValid())
-                    {
-                        return true;
-                    }
-                    else if(rtime.isValid())
-                    {
-                        return false;
-                    }
-                }
-                else if constexpr(SortCol == SortField::Resolution)
-                {
-                    QSize lsize = limg->size();
-                    QSize rsize = rimg->size();
-
-                    if(lsize.isValid() && rsize.isValid())
-                    {
-                        if(lsize.width() != rsize.width() && lsize.height() != rsize.height())
-                        {
-                            return static_cast<size_t>(lsize.width()) * lsize.height() < static_cast<size_t>(rsize.width()) * rsize.height();
-                        }
-                    }
-                    else if(lsize.isValid())
-                    {
-                        return true;
-                    }
-                    else if(rsize.isValid())
-                    {
-                        return false;
-                    }
-                }
-                else if constexpr(SortCol == SortField::Aperture)
-                {
-                    double lap, rap;
-                    lap = rap = std::numeric_limits<double>::max();
-
-                    lexif->aperture(lap);
-                    rexif->aperture(rap);
-
-                    if(lap != rap)
-                    {
-                        return lap < rap;
-                    }
-                }
-                else if constexpr(SortCol == SortField::Exposure)
-                {
-                    double lex, rex;
-                    lex = rex = std::numeric_limits<double>::max();
-
-                    lexif->exposureTime(lex);
-                    rexif->exposureTime(rex);
-
-                    if(lex != rex)
-                    {
-                        return lex < rex;
-                    }
-                }
-                else if constexpr(SortCol == SortField::Iso)
-                {
-                    int64_t liso, riso;
-                    liso = riso = std::numeric_limits<int64_t>::max();
-
-                    lexif->iso(liso);
-                    rexif->iso(riso);
-
-                    if(liso != riso)
-                    {
-                        return liso < riso;
-                    }
-                }
-                else if constexpr(SortCol == SortField::FocalLength)
-                {
-                    double ll, rl;
-                    ll = rl = std::numeric_limits<double>::max();
-
-                    lexif->focalLength(ll);
-                    rexif->focalLength(rl);
-
-                    if(ll != rl)
-                    {
-                        return ll < rl;
-                    }
-                }
-                else if constexpr(SortCol == SortField::Lens)
-                {
-                    QString ll, rl;
-
-                    ll = lexif->lens();
-                    rl = rexif->lens();
-
-                    if(!ll.isEmpty() && !rl.isEmpty())
-                    {
-                        return ll < rl;
-                    }
-                    else if(!ll.isEmpty())
-                    {
-                        return true;
-                    }
-                    else if(!rl.isEmpty())
-                    {
-                        return false;
-                    }
-                }
-                else if constexpr(SortCol == SortField::CameraModel)
-                {
-                    throw std::logic_error("not yet implemented");
-                }
-                else
-                {
-                    //                 static_assert("Unknown SortField to sort for");
-                }
-            }
-            else if(lexif && !rexif)
-            {
-                return true; // l before r
-            }
-            else if(!lexif && rexif)
-            {
-                return false; // l behind r
-            }
+            return l.str < r.str;
         }
 
-        return leftFileNameIsBeforeRight;
+        return compareFileName(l, r);
     }
 
     // This is the entry point for sorting. It sorts all Directories first.
     // Second criteria is to sort according to fileName
-    // For regular files it dispatches the call to sortColumnPredicateLeftBeforeRight()
+    // For regular files it dispatches the call to sortKeyLeftBeforeRight()
     //
     // |   L  \   R    | DIR  | SortCol | UNKNOWN |
     // |      DIR      |  1   |   1     |    1    |
     // |     SortCol   |  0   |   1     |    1    |
     // |    UNKNOWN    |  0   |   0     |    1    |
     //
-    template<SortField SortCol>
-    static bool topLevelSortFunction(Qt::SortOrder order, const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
+    static bool topLevelSortFunction(Qt::SortOrder order, const SortKey &l, const SortKey &r)
     {
-        const QFileInfo &linfo = l->fileInfo();
-        const QFileInfo &rinfo = r->fileInfo();
-
-        bool leftIsBeforeRight;
+        if(l.isDir || r.isDir)
+        {
+            return l.isDir && (!r.isDir || compareFileName(l, r));
+        }
 
         switch(order)
         {
         default:
         case Qt::AscendingOrder:
-            leftIsBeforeRight =
-                (linfo.isDir() && (!rinfo.isDir() || compareFileName(linfo, rinfo))) ||
-                (!rinfo.isDir() && sortColumnPredicateLeftBeforeRight<SortCol>(l, linfo, r, rinfo));
-            break;
+            return sortKeyLeftBeforeRight(l, r);
 
         case Qt::DescendingOrder:
-            leftIsBeforeRight =
-                (linfo.isDir() && (!rinfo.isDir() || compareFileName(linfo, rinfo))) ||
-                (!rinfo.isDir() && sortColumnPredicateLeftBeforeRight<SortCol>(r, rinfo, l, linfo));
-            break;
+            return sortKeyLeftBeforeRight(r, l);
         }
-
-        return leftIsBeforeRight;
     }
 
-    std::function<bool(const QSharedPointer<Image>&, const QSharedPointer<Image>&)> getSortFunction(SortField field, Qt::SortOrder order)
+    // Merge sort, which splits large ranges into OpenMP tasks. Outside of a parallel region, the tasks are executed immediately.
+    // buf must provide space for as many elements as [first, last).
+    static void parallelMergeSort(SortKey *first, SortKey *last, SortKey *buf, Qt::SortOrder order)
     {
-        switch(field)
-        {
-        case SortField::FileName:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::FileName>(order, l, r);
-            };
-
-        case SortField::FileSize:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::FileSize>(order, l, r);
-            };
-
-        case SortField::FileType:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::FileType>(order, l, r);
-            };
-
-        case SortField::DateModified:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::DateModified>(order, l, r);
-            };
+        constexpr std::ptrdiff_t SerialThreshold = 4096;
 
-        case SortField::Resolution:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::Resolution>(order, l, r);
-            };
-
-        case SortField::DateRecorded:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::DateRecorded>(order, l, r);
-            };
+        auto sortFunction = [order](const SortKey & l, const SortKey & r)
+        {
+            return topLevelSortFunction(order, l, r);
+        };
 
-        case SortField::Aperture:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::Aperture>(order, l, r);
-            };
+        std::ptrdiff_t n = last - first;
 
-        case SortField::Exposure:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::Exposure>(order, l, r);
-            };
+        if(n <= SerialThreshold)
+        {
+            std::sort(first, last, sortFunction);
+            return;
+        }
 
-        case SortField::Iso:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::Iso>(order, l, r);
-            };
+        SortKey *mid = first + n / 2;
 
-        case SortField::FocalLength:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::FocalLength>(order, l, r);
-            };
+#ifdef _OPENMP
+        #pragma omp task firstprivate(first, mid, buf, order)
+#endif
+        parallelMergeSort(first, mid, buf, order);
 
-        case SortField::Lens:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::Lens>(order, l, r);
-            };
+        parallelMergeSort(mid, last, buf + (mid - first), order);
 
-        case SortField::CameraModel:
-            return [ = ](const QSharedPointer<Image> &l, const QSharedPointer<Image> &r)
-            {
-                return topLevelSortFunction<SortField::CameraModel>(order, l, r);
-            };
+#ifdef _OPENMP
+        #pragma omp taskwait
+#endif
 
-        default:
-            throw std::logic_error(Formatter() << "No sorting function implemented for SortField " << (int)field);
-        }
+        std::move(first, last, buf);
+        SortKey *bufMid = buf + (mid - first);
+        std::merge(std::make_move_iterator(buf), std::make_move_iterator(bufMid),
+                   std::make_move_iterator(bufMid), std::make_move_iterator(buf + n),
+                   first, sortFunction);
     }
 };
 
@@ -346,6 +312,11 @@ SectionItem::SectionItem(const QVariant &itemid, SortField field, Qt::SortOrder
 /* Returns the name of the section item as a QString value. If no name is set, an empty value is returned. */
 QString SectionItem::getName() const
 {
+    if(!d->name.isEmpty())
+    {
+        return d->name;
+    }
+
     if(this->varId.isValid())
     {
         switch(this->varId.typeId())
@@ -353,6 +324,12 @@ QString SectionItem::getName() const
         case QMetaType::QDate:
             return this->varId.toDate().toString("yyyy-MM-dd (dddd)");
 
+        case QMetaType::QSize:
+        {
+            QSize size = this->varId.toSize();
+            return QStringLiteral("%1 x %2").arg(size.width()).arg(size.height());
+        }
+
         default:
             return this->varId.toString();
         }
@@ -363,6 +340,12 @@ QString SectionItem::getName() const
     }
 }
 
+/* Sets the name to display instead of the one derived from the item id. */
+void SectionItem::setName(const QString &name)
+{
+    d->name = name;
+}
+
 /* Sets the name (itemid) of the section item as the type of QVariant. */
 void SectionItem::setItemID(const QVariant &itemid)
 {
@@ -380,14 +363,40 @@ void SectionItem::sortItems(SortField field, Qt::SortOrder order)
 {
     d->imageSortField = field;
     d->imageSortOrder = order;
-    auto sortFunction = d->getSortFunction(field, order);
-    std::sort(/*std::execution::par_unseq, */this->d->data.begin(), this->d->data.end(), sortFunction);
+
+    // sort a contiguous array of precomputed keys and permute the ImageList only once afterwards
+    std::vector<Impl::SortKey> keys;
+    keys.reserve(d->data.size());
+
+    for(size_t i = 0; i < d->data.size(); i++)
+    {
+        keys.push_back(Impl::makeSortKey(field, d->data[i], static_cast<uint32_t>(i)));
+    }
+
+    std::vector<Impl::SortKey> buf(keys.size());
+    Impl::parallelMergeSort(keys.data(), keys.data() + keys.size(), buf.data(), order);
+
+    ImageList sorted;
+
+    for(const Impl::SortKey &k : keys)
+    {
+        sorted.push_back(std::move(d->data[k.index]));
+    }
+
+    d->data.swap(sorted);
 }
 
 SectionItem::ImageList::iterator SectionItem::findInsertPosition(const QSharedPointer<Image> &img)
 {
-    auto sortFunction = d->getSortFunction(d->imageSortField, d->imageSortOrder);
-    auto upper = std::upper_bound(this->d->data.begin(), this->d->data.end(), img, sortFunction);
+    SortField field = d->imageSortField;
+    Qt::SortOrder order = d->imageSortOrder;
+    const Impl::SortKey key = Impl::makeSortKey(field, img);
+
+    auto upper = std::upper_bound(this->d->data.begin(), this->d->data.end(), key,
+                                  [ = ](const Impl::SortKey & k, const QSharedPointer<Image> &e)
+    {
+        return Impl::topLevelSortFunction(order, k, Impl::makeSortKey(field, e));
+    });
     return upper;
 }
 
@@ -452,6 +461,12 @@ void SectionItem::insert(ImageList::iterator it, QSharedPointer<Image> &img)
     this->d->data.insert(it, img);
 }
 
+/* Appends an image without respecting the sort order. sortItems() must be called afterwards. */
+void SectionItem::append(const QSharedPointer<Image> &img)
+{
+    this->d->data.push_back(img);
+}
+
 void SectionItem::erase(ImageList::iterator it)
 {
     this->d->data.erase(it);
@@ -475,7 +490,8 @@ void SectionItem::clear()
 
 /* Returns true if the name of the item is less than the given item (item). Otherwise false is returned.
    If the name is of type QString, then the name of item is lexically less than the name of the given item.
-   If the name is of type QDate, then the name of item is older than the name of the given item. */
+   If the name is of type QDate, then the name of item is older than the name of the given item.
+   Numbers are compared numerically, and sizes by their area. */
 bool SectionItem::operator< (const SectionItem &item) noexcept(false)
 {
     if(this->varId.typeId() != item.varId.typeId())
@@ -483,19 +499,13 @@ bool SectionItem::operator< (const SectionItem &item) noexcept(false)
         return false;
     }
 
-    if(this->varId.typeId() == QMetaType::QDate)
-    {
-        return this->varId.toDate() < item.varId.toDate();
-    }
-    else
-    {
-        return this->varId.toString() < item.varId.toString();
-    }
+    return Impl::idLessThan(this->varId, item.varId);
 }
 
 /* Returns true if the name of the item is greater than the given item (item). Otherwise false is returned.
    If the name is of type QString, then the name of item is lexically greater than the name of the given item.
-   If the name is of type QDate, then the name of item is newer than the name of the given item. */
+   If the name is of type QDate, then the name of item is newer than the name of the given item.
+   Numbers are compared numerically, and sizes by their area. */
 bool SectionItem::operator> (const SectionItem &item) noexcept(false)
 {
     if(this->varId.typeId() != item.varId.typeId())
@@ -503,12 +513,5 @@ bool SectionItem::operator> (const SectionItem &item) noexcept(false)
         return false;
     }
 
-    if(this->varId.typeId() == QMetaType::QDate)
-    {
-        return this->varId.toDate() > item.varId.toDate();
-    }
-    else
-    {
-        return this->varId.toString() > item.varId.toString();
-    }
+    return Impl::idLessThan(item.varId, this->varId);
 }
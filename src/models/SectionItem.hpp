@@ -23,6 +23,7 @@ public:
     ~SectionItem() override;
 
     QString getName() const override;
+    void setName(const QString &name);
 
     void setItemID(const QVariant &itemid);
     QVariant getItemID() const;
@@ -37,6 +38,7 @@ public:
     bool find(QFileInfo item, int *externalIdx);
     int find(const QFileInfo info, ImageList::iterator *itout);
     void insert(ImageList::iterator it, QSharedPointer<Image> &img);
+    void append(const QSharedPointer<Image> &img);
     void erase(ImageList::iterator it);
     size_t size() const;
     QSharedPointer<AbstractListItem> at(int idx) const;
@@ -17,6 +17,9 @@
 #include <deque>
 #include <iterator>
 #include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <vector>
 
 #ifdef _WINDOWS
 #define NOMINMAX
@@ -56,7 +59,14 @@ struct SortedImageModel::Impl
     int cachedIconHeight = 1;
     std::atomic<ViewFlags_t> cachedViewFlags{ static_cast<ViewFlags_t>(ViewFlag::None) };
 
-    QPointer<QTimer> layoutChangedTimer;
+    // items whose thumbnail has changed, collected from any thread and announced once per frame by thumbnailFlushTimer.
+    // Only used for comparison, as the items may have been destroyed by then.
+    std::mutex readyThumbnailsMtx;
+    std::unordered_set<const AbstractListItem *> readyThumbnails;
+    QPointer<QTimer> thumbnailFlushTimer;
+
+    // size of the decoration last announced per item, to tell whether a new thumbnail changes the size hint of its row
+    std::unordered_map<const AbstractListItem *, QSize> decorationSizes;
 
     QPointer<QFutureWatcher<DecodingState>> directoryWorker;
 
@@ -89,8 +99,6 @@ struct SortedImageModel::Impl
             }
         }
 
-        layoutChangedTimer->stop();
-
         // now, walk through the list again and wait for the decoders to actually finish
         // do not delete all backgroundTasks as it may already contain tasks for images from a new directory
         // it should be fine to wait while holding the lock
@@ -110,32 +118,115 @@ struct SortedImageModel::Impl
         }
     }
 
-    void updateLayout()
+    // may be called from any thread
+    void onThumbnailChanged(Image *img)
     {
-        xThreadGuard g(q);
-        if(!layoutChangedTimer->isActive())
+        bool first;
+        {
+            std::lock_guard<std::mutex> l(this->readyThumbnailsMtx);
+            first = this->readyThumbnails.empty();
+            this->readyThumbnails.insert(static_cast<const AbstractListItem *>(img));
+        }
+
+        if(first)
         {
-            layoutChangedTimer->start();
+            QMetaObject::invokeMethod(this->thumbnailFlushTimer, qOverload<>(&QTimer::start), Qt::AutoConnection);
         }
     }
 
-    void forceUpdateLayout()
+    // returns true if the decoration of item differs in size from the one last announced, i.e. if its row needs to be laid out again
+    bool updateDecorationSize(const QSharedPointer<AbstractListItem> &item)
     {
-        // emitting signals is threadsafe, so no xThreadGuard required
-        emit q->layoutAboutToBeChanged();
-        emit q->layoutChanged();
+        auto img = AbstractListItem::imageCast(item);
+
+        if(!img)
+        {
+            return false;
+        }
+
+        // Neither create a pixmap nor request a rendition for every thumbnail. Only fallback icons are looked up, which come without side effects.
+        QSize size = img->thumbnailSize();
+
+        if(!size.isValid())
+        {
+            size = img->thumbnailTransformed(this->cachedIconHeight).size();
+        }
+
+        auto [it, inserted] = this->decorationSizes.try_emplace(item.data(), size);
+
+        if(inserted)
+        {
+            return true;
+        }
+
+        if(it->second == size)
+        {
+            return false;
+        }
+
+        it->second = size;
+        return true;
     }
 
-    void onThumbnailChanged(Image *img)
+    // Emits dataChanged() for the collected items, merging adjacent rows into ranges.
+    // Only rows whose decoration changed in size are announced with the SizeHintRole, so that the view doesn't need to relayout the others.
+    void flushReadyThumbnails()
     {
         xThreadGuard g(q);
-        QModelIndex m = q->index(img);
 
-        if(m.isValid())
+        std::unordered_set<const AbstractListItem *> ready;
         {
-            emit q->dataChanged(m, m, { Qt::DecorationRole });
-            this->updateLayout();
+            std::lock_guard<std::mutex> l(this->readyThumbnailsMtx);
+            ready.swap(this->readyThumbnails);
+        }
+
+        size_t remaining = ready.size();
+        int first = -1;
+        bool firstResized = false;
+        int row = 0;
+
+        auto emitRange = [&](int last)
+        {
+            if(first < 0)
+            {
+                return;
+            }
+
+            QList<int> roles{ Qt::DecorationRole };
+
+            if(firstResized)
+            {
+                roles.append(Qt::SizeHintRole);
+            }
+
+            emit q->dataChanged(q->index(first, 0), q->index(last, 0), roles);
+            first = -1;
+        };
+
+        for(auto it = this->visibleItemList.begin(); it != this->visibleItemList.end() && (remaining > 0 || first >= 0); ++it, row++)
+        {
+            if(ready.count(it->data()) == 0)
+            {
+                emitRange(row - 1);
+                continue;
+            }
+
+            remaining--;
+            bool resized = this->updateDecorationSize(*it);
+
+            if(first >= 0 && resized != firstResized)
+            {
+                emitRange(row - 1);
+            }
+
+            if(first < 0)
+            {
+                first = row;
+                firstResized = resized;
+            }
         }
+
+        emitRange(row - 1);
     }
 
     void onCheckStateChanged(Image* img)
@@ -160,6 +251,9 @@ struct SortedImageModel::Impl
         }
         else if(newState == DecodingState::Metadata)
         {
+            // the image might have been put into the unnamed section, because the sections were regrouped before its metadata was available
+            this->entries->updateSectionOfImage(img);
+
             // disabled to prevent noise, as it's not important
             // emit q->dataChanged(idx, idx, { Qt::ToolTipRole });
         }
@@ -190,9 +284,7 @@ struct SortedImageModel::Impl
 
             if(this->backgroundTasks.empty())
             {
-                QMetaObject::invokeMethod(this->layoutChangedTimer, &QTimer::stop);
                 ANPV::globalInstance()->spinningIconHelper()->stopRendering();
-                this->forceUpdateLayout();
                 emit q->backgroundProcessingStopped();
             }
         }
@@ -205,11 +297,13 @@ struct SortedImageModel::Impl
 
 SortedImageModel::SortedImageModel(QObject *parent) : QAbstractTableModel(parent), d(std::make_unique<Impl>(this))
 {
-    d->layoutChangedTimer = new QTimer(this);
-    d->layoutChangedTimer->setSingleShot(true);
-    connect(d->layoutChangedTimer, &QTimer::timeout, this, [&]()
+    // about one frame
+    d->thumbnailFlushTimer = new QTimer(this);
+    d->thumbnailFlushTimer->setSingleShot(true);
+    d->thumbnailFlushTimer->setInterval(16);
+    connect(d->thumbnailFlushTimer, &QTimer::timeout, this, [&]()
     {
-        d->forceUpdateLayout();
+        d->flushReadyThumbnails();
     });
 
     d->entries.reset(new ImageSectionDataContainer(this));
@@ -219,11 +313,6 @@ SortedImageModel::SortedImageModel(QObject *parent) : QAbstractTableModel(parent
     //connect(ANPV::globalInstance()->backgroundThread(), &QThread::finished, q, [&]() { this->fileModel = nullptr; }); // for some reason the destroyed event is not emitted or processed, leaving the pointer dangling without this
 
     d->directoryWorker = new QFutureWatcher<DecodingState>(this);
-    connect(d->directoryWorker, &QFutureWatcher<DecodingState>::started, this, [&]()
-    {
-        d->layoutChangedTimer->stop();
-        d->layoutChangedTimer->setInterval(500);
-    });
     connect(d->directoryWorker, &QFutureWatcher<DecodingState>::canceled, this, [&]()
     {
         d->cancelAllBackgroundTasks();
@@ -233,7 +322,8 @@ SortedImageModel::SortedImageModel(QObject *parent) : QAbstractTableModel(parent
             [&](int v)
     {
         d->cachedIconHeight = v;
-        d->updateLayout();
+        // the size of every row changes, which the view takes care of by itself
+        d->decorationSizes.clear();
     });
 
     connect(ANPV::globalInstance(), &ANPV::imageSortOrderChanged, this,
@@ -462,7 +552,7 @@ QVariant SortedImageModel::data(AbstractListItem* item, int role) const
                             return exif->lens();
 
                         case ItemImageCameraModel:
-                            throw std::logic_error("ItemImageCameraModel not yet implemented");
+                            return exif->cameraModel();
                         }
                     }
 
@@ -472,6 +562,12 @@ QVariant SortedImageModel::data(AbstractListItem* item, int role) const
                 case Qt::DecorationRole:
                     return img->thumbnailTransformed(d->cachedIconHeight);
 
+                case ItemThumbnailImage:
+                    return img->thumbnailImage(d->cachedIconHeight);
+
+                case ItemThumbnailSize:
+                    return img->thumbnailSize();
+
                 case Qt::ToolTipRole:
                 {
                     switch (img->decodingState())
@@ -574,10 +670,6 @@ bool SortedImageModel::insertRows(int row, std::list<QSharedPointer<AbstractList
 
     this->endInsertRows();
 
-    // We override ThumbnailListView::rowsInserted() to avoid flickering, but the view needs a call to QListView::doItemsLayout() when inserting items to correctly show the icons.
-    // If we read a directory with reading EXIF data, the thumbnails will already be ready and therefore no layout change events will be emitted.
-    // And that's why we update the layout here.
-    d->updateLayout();
     return true;
 }
 
@@ -640,6 +732,11 @@ bool SortedImageModel::removeRows(int row, int count, const QModelIndex &parent)
         }
     }
 
+    for(auto it = first; it != last; ++it)
+    {
+        d->decorationSizes.erase(it->data());
+    }
+
     // now that all pending background tasks have been removed, we can delete the owning references to those images
     d->visibleItemList.erase(first, last);
 
@@ -648,6 +745,76 @@ bool SortedImageModel::removeRows(int row, int count, const QModelIndex &parent)
     return true;
 }
 
+// Applies a new order of the rows by emitting a single layoutChanged and remapping all persistent indices.
+// items is expected to be a permutation of the currently visible items. Items unknown to the model are ignored, because
+// they are going to be inserted by a pending insertRows() call. Items not contained in the list are moved to the end.
+void SortedImageModel::reorderRows(const std::list<QSharedPointer<AbstractListItem>> &items)
+{
+    xThreadGuard(this);
+
+    const int rows = static_cast<int>(d->visibleItemList.size());
+
+    std::unordered_map<const AbstractListItem *, int> oldRows;
+    oldRows.reserve(rows);
+
+    for(int i = 0; i < rows; i++)
+    {
+        oldRows[d->visibleItemList[i].data()] = i;
+    }
+
+    std::deque<QSharedPointer<AbstractListItem>> newList;
+    std::vector<int> oldToNew(rows, -1);
+
+    for(const auto &e : items)
+    {
+        auto it = oldRows.find(e.data());
+
+        if(it != oldRows.end() && oldToNew[it->second] < 0)
+        {
+            oldToNew[it->second] = static_cast<int>(newList.size());
+            newList.push_back(e);
+        }
+    }
+
+    for(int i = 0; i < rows; i++)
+    {
+        if(oldToNew[i] < 0)
+        {
+            oldToNew[i] = static_cast<int>(newList.size());
+            newList.push_back(d->visibleItemList[i]);
+        }
+    }
+
+    emit this->layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    QModelIndexList from = this->persistentIndexList();
+    QModelIndexList to;
+    to.reserve(from.size());
+
+    for(const QModelIndex &idx : from)
+    {
+        int row = (idx.row() >= 0 && idx.row() < rows) ? oldToNew[idx.row()] : -1;
+        to.append(row < 0 ? QModelIndex() : this->createIndex(row, idx.column(), newList[row].data()));
+    }
+
+    d->visibleItemList.swap(newList);
+    this->changePersistentIndexList(from, to);
+
+    emit this->layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+// Replaces all rows by a single model reset, e.g. after the sections have been regrouped.
+// Unlike removeRows(), this doesn't cancel any background tasks, as the images are expected to be contained in items again.
+void SortedImageModel::resetRows(const std::list<QSharedPointer<AbstractListItem>> &items)
+{
+    xThreadGuard(this);
+
+    this->beginResetModel();
+    d->visibleItemList.assign(items.begin(), items.end());
+    d->decorationSizes.clear();
+    this->endResetModel();
+}
+
 QModelIndex SortedImageModel::index(const QSharedPointer<Image> &img)
 {
     xThreadGuard(this);
@@ -669,7 +836,8 @@ QModelIndex SortedImageModel::index(const Image *img)
     {
         if(i.data() == static_cast<const AbstractListItem *>(img))
         {
-            return this->createIndex(k, 0, img);
+            // the internal pointer must always be an AbstractListItem, see data()
+            return this->createIndex(k, 0, i.data());
         }
 
         k++;
@@ -735,10 +903,11 @@ void SortedImageModel::welcomeImage(const QSharedPointer<Image>& image)
             d->onBackgroundImageTaskStateChanged(img, newState, old);
         });
 
+    // directly connected, so that decoding threads don't flood the event loop, see onThumbnailChanged()
     this->connect(image.data(), &Image::thumbnailChanged, this, [&](Image* i, QImage)
         {
             d->onThumbnailChanged(i);
-        });
+        }, Qt::DirectConnection);
 
     this->connect(image.data(), &Image::checkStateChanged, this,
         [&](Image* i, int c, int old)
@@ -804,8 +973,3 @@ void SortedImageModel::cancelAllBackgroundTasks()
     xThreadGuard(this);
     d->cancelAllBackgroundTasks();
 }
-
-void SortedImageModel::setLayoutTimerInterval(qint64 t)
-{
-    d->layoutChangedTimer->setInterval(t);
-}
@@ -43,6 +43,11 @@ public:
         ItemImageLens,
         ItemImageCameraModel,
         ItemBackgroundTask,
+        // the thumbnail as QImage scaled to about the icon height, null if there is none yet; cheaper than ItemThumbnail, as no pixmap is involved.
+        // Meant for painting, as a missing rendition of the icon height is requested.
+        ItemThumbnailImage,
+        // the size of the rotated thumbnail, invalid if there is none yet; independent of the icon height and free of side effects, meant for layouting
+        ItemThumbnailSize,
     };
 
     SortedImageModel(QObject *parent = nullptr);
@@ -70,7 +75,8 @@ public:
     void attachTaskToImage(const QSharedPointer<Image>& image, const QSharedPointer<QFutureWatcher<DecodingState>>& watcher);
 
     bool insertRows(int row, std::list<QSharedPointer<AbstractListItem>> &items);
-    void setLayoutTimerInterval(qint64 t);
+    void reorderRows(const std::list<QSharedPointer<AbstractListItem>> &items);
+    void resetRows(const std::list<QSharedPointer<AbstractListItem>> &items);
 
 public: // QAbstractItemModel
 
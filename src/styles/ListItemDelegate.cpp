@@ -8,17 +8,22 @@
 #include <QFutureWatcher>
 #include <QApplication>
 
+#include <algorithm>
+
 #include "types.hpp"
 #include "SortedImageModel.hpp"
 #include "ANPV.hpp"
 #include "ProgressIndicatorHelper.hpp"
+#include "ThumbnailAtlas.hpp"
 
 /* Constructs a ItemDelegate object. */
 ListItemDelegate::ListItemDelegate(QObject *parent)
-    : QStyledItemDelegate(parent), szSectionSize(40, 40)
+    : QStyledItemDelegate(parent), szSectionSize(40, 40), atlas(std::make_unique<ThumbnailAtlas>())
 {
 }
 
+ListItemDelegate::~ListItemDelegate() = default;
+
 /* reimpl. */
 void ListItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
 {
@@ -45,7 +50,85 @@ void ListItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
         }
         else
         {
-            this->QStyledItemDelegate::paint(painter, option, index);
+            QImage thumb = model->data(index, SortedImageModel::ItemThumbnailImage).value<QImage>();
+
+            if(thumb.isNull())
+            {
+                this->QStyledItemDelegate::paint(painter, option, index);
+            }
+            else
+            {
+                this->paintThumbnail(painter, option, index, thumb);
+            }
+        }
+    }
+}
+
+/* Paints an image item, taking its thumbnail (thumb) from the atlas rather than from a pixmap of its own. */
+void ListItemDelegate::paintThumbnail(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index, const QImage &thumb) const
+{
+    const int iconHeight = option.decorationSize.height();
+
+    // initStyleOption() would query the Qt::DecorationRole, i.e. create the very pixmap we are trying to avoid
+    QStyleOptionViewItem opt = option;
+    opt.index = index;
+    opt.text = index.data(Qt::DisplayRole).toString();
+    opt.displayAlignment = Qt::Alignment(index.data(Qt::TextAlignmentRole).toInt());
+    opt.features |= QStyleOptionViewItem::HasDisplay | QStyleOptionViewItem::HasDecoration;
+    opt.decorationSize = QSize(thumb.height() > 0 ? thumb.width() * iconHeight / thumb.height() : iconHeight, iconHeight);
+    opt.icon = QIcon();
+
+    QVariant check = index.data(Qt::CheckStateRole);
+
+    if(check.isValid())
+    {
+        opt.features |= QStyleOptionViewItem::HasCheckIndicator;
+        opt.checkState = static_cast<Qt::CheckState>(check.toInt());
+    }
+
+    const QWidget *widget = option.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+
+    // everything but the thumbnail, as there is no icon
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+
+    QRect source;
+    const QPixmap *page = this->atlas->lookup(thumb, iconHeight, source);
+    QRect target = style->subElementRect(QStyle::SE_ItemViewItemDecoration, &opt, widget);
+    target = QStyle::alignedRect(opt.direction, Qt::AlignCenter, page != nullptr ? source.size() : opt.decorationSize, target);
+
+    painter->save();
+
+    if(!(opt.state & QStyle::State_Enabled))
+    {
+        // what QIcon::Disabled would roughly look like
+        painter->setOpacity(0.5);
+    }
+
+    if(page != nullptr)
+    {
+        painter->drawPixmap(target, *page, source);
+    }
+    else
+    {
+        // too large for the atlas
+        painter->setRenderHint(QPainter::SmoothPixmapTransform);
+        painter->drawImage(target, thumb);
+    }
+
+    painter->restore();
+
+    if(opt.features & QStyleOptionViewItem::HasCheckIndicator)
+    {
+        QStyleOptionViewItem checkOpt = opt;
+        checkOpt.rect = style->subElementRect(QStyle::SE_ItemViewItemCheckIndicator, &opt, widget);
+
+        if(checkOpt.rect.intersects(target))
+        {
+            // the style drew it before the thumbnail
+            checkOpt.state &= ~QStyle::State_HasFocus;
+            checkOpt.state |= opt.checkState == Qt::Checked ? QStyle::State_On : (opt.checkState == Qt::PartiallyChecked ? QStyle::State_NoChange : QStyle::State_Off);
+            style->drawPrimitive(QStyle::PE_IndicatorItemViewItemCheck, &checkOpt, painter, widget);
         }
     }
 }
@@ -106,7 +189,24 @@ QSize ListItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QMode
     }
     else
     {
-        return this->QStyledItemDelegate::sizeHint(option, index);
+        // All image items share the same height, given by option.decorationSize, while their width follows the aspect ratio of the thumbnail.
+        // That allows the view to lay them out in rows of fixed height without measuring their text.
+        const int iconHeight = option.decorationSize.height();
+        // only the aspect ratio matters, which doesn't depend on the rendition and doesn't request one
+        QSize decoration = index.data(SortedImageModel::ItemThumbnailSize).toSize();
+
+        if(!decoration.isValid())
+        {
+            // a fallback icon
+            QStyleOptionViewItem opt = option;
+            this->initStyleOption(&opt, index);
+            decoration = opt.decorationSize;
+        }
+
+        int width = decoration.height() > 0 ? decoration.width() * iconHeight / decoration.height() : iconHeight;
+        width = std::max(width, 8 * option.fontMetrics.averageCharWidth());
+
+        return QSize(width + this->margin(option), this->tileHeight(option));
     }
 }
 
@@ -115,3 +215,23 @@ void ListItemDelegate::resizeSectionSize(const QSize &newsize)
 {
     this->szSectionSize.setWidth(newsize.width());
 }
+
+/* Returns the height of a section item. */
+int ListItemDelegate::sectionHeight() const
+{
+    return this->szSectionSize.height();
+}
+
+/* Returns the height of all image items, enough for the thumbnail and a few lines of text. */
+int ListItemDelegate::tileHeight(const QStyleOptionViewItem &option) const
+{
+    return option.decorationSize.height() + TextLines * option.fontMetrics.lineSpacing() + 2 * this->margin(option);
+}
+
+/* Returns the space around the thumbnail and the text. */
+int ListItemDelegate::margin(const QStyleOptionViewItem &option) const
+{
+    const QWidget *widget = option.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+    return 2 * (style->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, widget) + 1);
+}
@@ -11,27 +11,42 @@
 #include <QRegularExpression>
 #include <QSize>
 #include <QFutureWatcher>
+#include <QImage>
+#include <memory>
 
 #include "DecodingState.hpp"
 
+class ThumbnailAtlas;
 
 class ListItemDelegate : public QStyledItemDelegate
 {
 public:
     ListItemDelegate(QObject *parent = nullptr);
+    ~ListItemDelegate() override;
     void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
 
     QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
 
     void resizeSectionSize(const QSize &newsize);
+    int sectionHeight() const;
+    int tileHeight(const QStyleOptionViewItem &option) const;
 
 protected:
     void paintSection(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
     void paintProgressIcon(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex&, const QFutureWatcher<DecodingState>* task) const;
+    void paintThumbnail(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index, const QImage &thumb) const;
 
 private:
+    /* lines of text shown below the thumbnail */
+    static constexpr int TextLines = 2;
+
+    int margin(const QStyleOptionViewItem &option) const;
+
     /* size of a section item */
     QSize szSectionSize;
+
+    /* thumbnails of all image items, scaled to the icon height */
+    std::unique_ptr<ThumbnailAtlas> atlas;
 };
 
 #endif /*H_IBIMAGEITEMDELEGATE*/
@@ -0,0 +1,155 @@
+
+#include "ThumbnailAtlas.hpp"
+
+#include <QPainter>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ThumbnailAtlas::Impl
+{
+    struct Page
+    {
+        QPixmap pixmap;
+        // where the next thumbnail goes; as all of them have the same height, the page is filled row by row
+        QPoint cursor;
+        quint64 lastUsed = 0;
+        std::vector<qint64> keys;
+    };
+
+    struct Entry
+    {
+        Page *page;
+        QRect rect;
+    };
+
+    int height = 0;
+    std::vector<std::unique_ptr<Page>> pages;
+    std::unordered_map<qint64, Entry> entries;
+    // incremented on every lookup, to find the least recently used page
+    quint64 clock = 0;
+
+    // reserves room for a thumbnail of the given width in page, returns a null rect if the page is full
+    QRect allocate(Page &page, int width) const
+    {
+        if(page.cursor.x() + width > PageSize)
+        {
+            page.cursor = QPoint(0, page.cursor.y() + this->height);
+        }
+
+        if(page.cursor.y() + this->height > PageSize)
+        {
+            return QRect();
+        }
+
+        QRect r(page.cursor, QSize(width, this->height));
+        page.cursor.rx() += width;
+        return r;
+    }
+
+    std::pair<Page *, QRect> allocate(int width)
+    {
+        for(auto &page : this->pages)
+        {
+            QRect r = this->allocate(*page, width);
+
+            if(!r.isNull())
+            {
+                return { page.get(), r };
+            }
+        }
+
+        Page *page;
+
+        if(this->pages.size() < static_cast<size_t>(MaxPages))
+        {
+            auto p = std::make_unique<Page>();
+            p->pixmap = QPixmap(PageSize, PageSize);
+            // gives the pixmap an alpha channel
+            p->pixmap.fill(Qt::transparent);
+            page = p.get();
+            this->pages.push_back(std::move(p));
+        }
+        else
+        {
+            auto lru = std::min_element(this->pages.begin(), this->pages.end(), [](const auto & a, const auto & b)
+            {
+                return a->lastUsed < b->lastUsed;
+            });
+            page = lru->get();
+
+            for(qint64 key : page->keys)
+            {
+                this->entries.erase(key);
+            }
+
+            // the old content needn't be cleared, it is overwritten before it is used again
+            page->keys.clear();
+            page->cursor = QPoint();
+        }
+
+        return { page, this->allocate(*page, width) };
+    }
+};
+
+ThumbnailAtlas::ThumbnailAtlas() : d(std::make_unique<Impl>())
+{
+}
+
+ThumbnailAtlas::~ThumbnailAtlas() = default;
+
+const QPixmap *ThumbnailAtlas::lookup(const QImage &thumb, int height, QRect &source)
+{
+    if(thumb.isNull() || height <= 0 || height > PageSize)
+    {
+        return nullptr;
+    }
+
+    if(height != d->height)
+    {
+        this->clear();
+        d->height = height;
+    }
+
+    const int width = std::max(1, qRound(thumb.width() * static_cast<double>(height) / thumb.height()));
+
+    if(width > PageSize)
+    {
+        return nullptr;
+    }
+
+    d->clock++;
+
+    auto it = d->entries.find(thumb.cacheKey());
+
+    if(it == d->entries.end())
+    {
+        auto [page, rect] = d->allocate(width);
+
+        QPainter p(&page->pixmap);
+        p.setCompositionMode(QPainter::CompositionMode_Source);
+        p.setRenderHint(QPainter::SmoothPixmapTransform);
+        p.drawImage(rect, thumb);
+        p.end();
+
+        page->keys.push_back(thumb.cacheKey());
+        it = d->entries.emplace(thumb.cacheKey(), Impl::Entry{ page, rect }).first;
+    }
+
+    it->second.page->lastUsed = d->clock;
+    source = it->second.rect;
+    return &it->second.page->pixmap;
+}
+
+void ThumbnailAtlas::clear()
+{
+    d->pages.clear();
+    d->entries.clear();
+    d->height = 0;
+}
+
+int ThumbnailAtlas::pageCount() const
+{
+    return static_cast<int>(d->pages.size());
+}
@@ -0,0 +1,37 @@
+
+#pragma once
+
+#include <QImage>
+#include <QPixmap>
+#include <QRect>
+#include <memory>
+
+/**
+ * Packs thumbnails scaled to a common height into a few large pixmaps, the pages. Painting a view full of thumbnails then draws
+ * sub-rectangles of the same few pixmaps, instead of converting and uploading one pixmap per thumbnail. Thumbnails are identified by the
+ * cache key of their image. Once all pages are full, the least recently used one is emptied. Must only be used from the GUI thread.
+ */
+class ThumbnailAtlas
+{
+public:
+    static constexpr int PageSize = 2048;
+    static constexpr int MaxPages = 4;
+
+    ThumbnailAtlas();
+    ~ThumbnailAtlas();
+
+    ThumbnailAtlas(const ThumbnailAtlas &) = delete;
+    ThumbnailAtlas &operator=(const ThumbnailAtlas &) = delete;
+
+    // Returns the page holding thumb scaled to height and sets source to the thumbnail's rectangle within it, adding thumb if necessary.
+    // A height different from the previous one empties the atlas. Returns nullptr if thumb is null or too large for a page.
+    // The page remains valid until the next call.
+    const QPixmap *lookup(const QImage &thumb, int height, QRect &source);
+    void clear();
+
+    int pageCount() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
@@ -0,0 +1,97 @@
+
+#include "DecodedImageItem.hpp"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+struct DecodedImageItem::Impl
+{
+    QImage image;
+    QPointF offset;
+    Qt::TransformationMode mode = Qt::FastTransformation;
+};
+
+DecodedImageItem::DecodedImageItem() : d(std::make_unique<Impl>())
+{
+    // needed for a valid exposedRect in paint()
+    this->setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+DecodedImageItem::~DecodedImageItem() = default;
+
+QImage DecodedImageItem::image() const
+{
+    return d->image;
+}
+
+void DecodedImageItem::setImage(const QImage &img)
+{
+    if(img.size() != d->image.size())
+    {
+        this->prepareGeometryChange();
+    }
+
+    d->image = img;
+    this->update();
+}
+
+QPointF DecodedImageItem::offset() const
+{
+    return d->offset;
+}
+
+void DecodedImageItem::setOffset(const QPointF &offset)
+{
+    if(offset == d->offset)
+    {
+        return;
+    }
+
+    this->prepareGeometryChange();
+    d->offset = offset;
+    this->update();
+}
+
+Qt::TransformationMode DecodedImageItem::transformationMode() const
+{
+    return d->mode;
+}
+
+void DecodedImageItem::setTransformationMode(Qt::TransformationMode mode)
+{
+    if(mode != d->mode)
+    {
+        d->mode = mode;
+        this->update();
+    }
+}
+
+void DecodedImageItem::updateImageRect(const QRect &r)
+{
+    this->update(QRectF(r).translated(d->offset));
+}
+
+QRectF DecodedImageItem::boundingRect() const
+{
+    return QRectF(d->offset, d->image.size());
+}
+
+void DecodedImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *)
+{
+    if(d->image.isNull())
+    {
+        return;
+    }
+
+    // align the exposed rect to whole pixels of the image to avoid seams when smoothly transformed
+    QRect source = option->exposedRect.translated(-d->offset).toAlignedRect().intersected(d->image.rect());
+
+    if(source.isEmpty())
+    {
+        return;
+    }
+
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, d->mode == Qt::SmoothTransformation);
+    // the image is only read from, painting it never detaches from the buffer shared with the decoder
+    painter->drawImage(QRectF(source).translated(d->offset), d->image, source);
+}
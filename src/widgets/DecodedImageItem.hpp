@@ -0,0 +1,36 @@
+
+#pragma once
+
+#include <QGraphicsItem>
+#include <QImage>
+#include <memory>
+
+/**
+ * Displays a QImage without converting it to a QPixmap first, i.e. it shares the pixel buffer with the decoder writing into it.
+ * Only the exposed part of the image is painted, so that updating small regions of a huge image remains cheap.
+ */
+class DecodedImageItem : public QGraphicsItem
+{
+public:
+    DecodedImageItem();
+    ~DecodedImageItem() override;
+
+    QImage image() const;
+    void setImage(const QImage &img);
+
+    QPointF offset() const;
+    void setOffset(const QPointF &offset);
+
+    Qt::TransformationMode transformationMode() const;
+    void setTransformationMode(Qt::TransformationMode mode);
+
+    // schedules a repaint of the given rect in pixel coordinates of the image, e.g. because the decoder has written to it
+    void updateImageRect(const QRect &r);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
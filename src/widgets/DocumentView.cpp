@@ -23,10 +23,17 @@
 #include <QMimeData>
 #include <QSettings>
 #include <QElapsedTimer>
+#include <QPromise>
+#include <QThreadPool>
 
 #include <vector>
 #include <algorithm>
 #include <optional>
+#include <iterator>
+#include <atomic>
+#include <memory>
+#include <cmath>
+#include <functional>
 
 #include "AfPointOverlay.hpp"
 #include "ExifOverlay.hpp"
@@ -40,8 +47,17 @@
 #include "xThreadGuard.hpp"
 #include "WaitCursor.hpp"
 #include "ImageSectionDataContainer.hpp"
+#include "TileCache.hpp"
+#include "SmoothScaler.hpp"
+#include "DecodedImageBudget.hpp"
+#include "DecodedImageItem.hpp"
+#include "TiledImageItem.hpp"
 
 constexpr qint64 MaxFovTimerInterval = 600;
+constexpr qint64 TileCacheBudget = 256 * 1024 * 1024;
+constexpr int DefaultPrefetchAhead = 2;
+constexpr int DefaultPrefetchBehind = 1;
+constexpr int DefaultPrefetchBudgetMiB = 512;
 
 struct DocumentView::Impl
 {
@@ -57,11 +73,17 @@ struct DocumentView::Impl
 
     // a smoothly scaled version of the full resolution image
     QGraphicsPixmapItem *smoothPixmapOverlay = nullptr;
+    QFuture<QImage> smoothFuture;
+    // shared with the scaling task, which may outlive us
+    QSharedPointer<std::atomic<quint64>> smoothGeneration = QSharedPointer<std::atomic<quint64>>::create(0);
 
     QGraphicsPixmapItem *thumbnailPreviewOverlay = nullptr;
 
-    QGraphicsPixmapItem *currentPixmapOverlay = nullptr;
-    QGraphicsPixmapItem *previousDecodedPixmapOverlay = nullptr;
+    DecodedImageItem *currentImageOverlay = nullptr;
+    DecodedImageItem *previousDecodedImageOverlay = nullptr;
+
+    // paints the visible tiles of the tileCache
+    TiledImageItem *tileCacheOverlay = nullptr;
 
     QAction *actionShowScrollBars = nullptr;
     QAction* actionShowInfoBox = nullptr;
@@ -76,6 +98,19 @@ struct DocumentView::Impl
 
     QFutureWatcher<DecodingState> taskFuture;
 
+    // Bumped for every decoding request. Results of a task started by an older generation have been superseded and are dropped on arrival.
+    quint64 decodeGeneration = 0;
+    quint64 taskGeneration = 0;
+    // the task has been cancelled in favour of a newer request, which is started once the task has finished
+    bool restartPending = false;
+    // the task belongs to the decoder of a previous image, it has been cancelled and its results are dropped
+    bool taskRetired = false;
+
+    // the decoding of the early metadata, in case the image size was not yet known when showing the image
+    QFuture<DecodingState> metadataFuture;
+    quint64 metadataGeneration = 0;
+    bool metadataPending = false;
+
     // the latest image decoder, the same that displays the current image
     QSharedPointer<SmartImageDecoder> currentImageDecoder;
 
@@ -85,11 +120,37 @@ struct DocumentView::Impl
     DecodingState latestDecodingState = DecodingState::Ready;
 
     // the full resolution image currently displayed in the scene
-    QPixmap currentDocumentPixmap;
+    QImage currentDocumentImage;
+
+    // previously decoded parts of the current image, to be reused when panning or zooming
+    std::unique_ptr<TileCache> tileCache;
+
+    // the decoded image has been released while we were hidden, only a preview of it is displayed until we're shown again
+    bool evictedToPreview = false;
+    // the downscaling of the decoded image started by evictToPreview()
+    QFuture<QImage> evictionFuture;
 
     // the model for the current directory needed for navigating back and forth
     QSharedPointer<ImageSectionDataContainer> model;
 
+    // an image decoded in the background, as it's likely to be navigated to next
+    struct Prefetch
+    {
+        QSharedPointer<SmartImageDecoder> decoder;
+        QSharedPointer<QFutureWatcher<DecodingState>> watcher;
+        // the decoded image is no longer wanted and will be released once the decoder has finished
+        bool evicted = false;
+    };
+
+    // ordered by how likely the images are navigated to, i.e. images ahead in navigation direction first
+    std::vector<Prefetch> prefetches;
+    int prefetchAhead = DefaultPrefetchAhead;
+    int prefetchBehind = DefaultPrefetchBehind;
+    qint64 prefetchBudget = qint64(DefaultPrefetchBudgetMiB) * 1024 * 1024;
+    int navigationDirection = 1;
+    // the currently displayed image is a prefetch, which was still being decoded when it was navigated to
+    bool prefetchAdopted = false;
+
     ViewFlags_t cachedViewFlags = ViewFlags_t(ViewFlag::None);
 
     Impl(DocumentView *parent) : q(parent)
@@ -98,18 +159,111 @@ struct DocumentView::Impl
     ~Impl()
     {
         this->clearScene();
+
+        for(Prefetch &p : this->prefetches)
+        {
+            p.watcher->disconnect(q);
+            p.decoder->cancelOrTake(p.watcher->future());
+            p.watcher->waitForFinished();
+            p.decoder->releaseFullImage();
+        }
+    }
+
+    // Calls fn once the task fut of dec has finished, without blocking the UI thread. dec is kept alive until then, as a decoder must not be
+    // destroyed while decoding.
+    static void whenDecoderFinished(const QSharedPointer<SmartImageDecoder> &dec, const QFuture<DecodingState> &fut, std::function<void()> fn)
+    {
+        if(fut.isFinished())
+        {
+            fn();
+            return;
+        }
+
+        // not owned by us, as the decoder may finish after we have been destroyed
+        auto *watcher = new QFutureWatcher<DecodingState>();
+        QObject::connect(watcher, &QFutureWatcher<DecodingState>::finished, watcher, [watcher, dec, fn = std::move(fn)]()
+        {
+            fn();
+            watcher->deleteLater();
+        });
+        watcher->setFuture(fut);
+    }
+
+    // whether the decoded image of img is still needed by us, i.e. it's displayed or being prefetched
+    bool isImageInUse(const QSharedPointer<Image> &img) const
+    {
+        bool inUse = this->currentImageDecoder && this->currentImageDecoder->image() == img;
+        inUse |= std::any_of(this->prefetches.begin(), this->prefetches.end(), [&](const Prefetch & other)
+        {
+            return !other.evicted && other.decoder->image() == img;
+        });
+        return inUse;
+    }
+
+    // Releases the decoded image of dec once its (cancelled) task fut has finished, unless the image has been navigated to again by then.
+    void releaseWhenFinished(const QSharedPointer<SmartImageDecoder> &dec, const QFuture<DecodingState> &fut)
+    {
+        QPointer<DocumentView> view(q);
+        QSharedPointer<Image> img = dec->image();
+
+        whenDecoderFinished(dec, fut, [this, view, dec, img]()
+        {
+            if(view.isNull() || !this->isImageInUse(img))
+            {
+                dec->releaseFullImage();
+            }
+        });
+    }
+
+    // the task of the current decoder, which is finished if there is none
+    QFuture<DecodingState> runningFuture() const
+    {
+        if(this->metadataPending)
+        {
+            return this->metadataFuture;
+        }
+
+        return this->taskRetired ? QFuture<DecodingState>() : this->taskFuture.future();
+    }
+
+    bool isTaskFinished() const
+    {
+        return this->taskRetired || this->taskFuture.isFinished();
     }
 
     void clearScene()
     {
         if(currentImageDecoder)
         {
-            currentImageDecoder->cancelOrTake(taskFuture.future());
-            taskFuture.waitForFinished();
-            currentImageDecoder->releaseFullImage();
+            // Never wait for the decoder, as it may take long to notice the cancellation, e.g. while reading from a slow network share.
+            // The results of its tasks are dropped on arrival instead.
+            QFuture<DecodingState> running = this->runningFuture();
+
+            if(metadataPending)
+            {
+                currentImageDecoder->cancelOrTake(metadataFuture);
+                metadataPending = false;
+            }
+
+            ++metadataGeneration;
+
+            if(!this->isTaskFinished())
+            {
+                currentImageDecoder->cancelOrTake(taskFuture.future());
+                // taskFuture keeps watching it until the next task is started
+                taskRetired = true;
+            }
+
+            restartPending = false;
+            prefetchAdopted = false;
+            taskGeneration = decodeGeneration;
+            evictionFuture.cancel();
             currentImageDecoder->image()->disconnect(q);
-            currentImageDecoder.reset();
+            QSharedPointer<SmartImageDecoder> dec;
+            dec.swap(currentImageDecoder);
+            this->releaseWhenFinished(dec, running);
             latestDecodingState = DecodingState::Ready;
+            evictedToPreview = false;
             // this makes ensures that the if clause will be entered next time we enter onViewportChanged(),
             // to display the next or previous image
             previousFovTransform = std::nullopt;
@@ -117,13 +271,17 @@ struct DocumentView::Impl
 
         removeSmoothPixmap();
 
-        currentDocumentPixmap = QPixmap();
-        currentPixmapOverlay->setPixmap(currentDocumentPixmap);
-        currentPixmapOverlay->setScale(1);
-        currentPixmapOverlay->hide();
+        currentDocumentImage = QImage();
+        currentImageOverlay->setImage(currentDocumentImage);
+        currentImageOverlay->setScale(1);
+        currentImageOverlay->hide();
 
-        previousDecodedPixmapOverlay->setPixmap(QPixmap());
-        previousDecodedPixmapOverlay->hide();
+        previousDecodedImageOverlay->setImage(QImage());
+        previousDecodedImageOverlay->hide();
+
+        tileCacheOverlay->setTileCache(nullptr);
+        tileCacheOverlay->hide();
+        tileCache.reset();
 
         thumbnailPreviewOverlay->setPixmap(QPixmap());
         thumbnailPreviewOverlay->hide();
@@ -196,11 +354,15 @@ struct DocumentView::Impl
 
     void removeSmoothPixmap()
     {
+        // cancel any scaling in progress
+        ++(*this->smoothGeneration);
+        this->smoothFuture.cancel();
+
         if(smoothPixmapOverlay)
         {
             smoothPixmapOverlay->setPixmap(QPixmap());
             smoothPixmapOverlay->hide();
-            currentPixmapOverlay->show();
+            currentImageOverlay->show();
         }
     }
 
@@ -208,13 +370,11 @@ struct DocumentView::Impl
     {
         xThreadGuard g(q);
 
-        if(currentDocumentPixmap.isNull())
+        if(currentDocumentImage.isNull())
         {
             return;
         }
 
-        WaitCursor w;
-
         // get the area of what the user sees
         QRect viewportRect = q->viewport()->rect();
 
@@ -222,7 +382,7 @@ struct DocumentView::Impl
         QRectF viewportRectScene = q->mapToScene(viewportRect).boundingRect();
 
         // the user might have zoomed out too far, crop the rect, as we are not interseted in the surrounding void
-        QRectF visPixRect = viewportRectScene.intersected(currentPixmapOverlay->sceneBoundingRect());
+        QRectF visPixRect = viewportRectScene.intersected(currentImageOverlay->sceneBoundingRect());
 
         // the "inverted zoom factor"
         // 1.0 means the pixmap is shown at native size
@@ -232,49 +392,133 @@ struct DocumentView::Impl
 
         if(newScale >= 1.0)
         {
-            currentPixmapOverlay->setTransformationMode(Qt::SmoothTransformation);
+            currentImageOverlay->setTransformationMode(Qt::SmoothTransformation);
         }
         else
         {
-            currentPixmapOverlay->setTransformationMode(Qt::FastTransformation);
+            currentImageOverlay->setTransformationMode(Qt::FastTransformation);
         }
 
-        return;
+        if(newScale <= 2.0)
+        {
+            qDebug() << "Skipping smooth pixmap scaling: Too far zoomed in";
+            return;
+        }
+
+        // The pixmap overlay may have been scaled; we must translate the visible Pixmap Rectangle (which is in scene coordinates) into the coordinates of the decoded image.
+        // Only scale the visible part, rather than the entire image.
+        QImage decoded = currentImageDecoder->image()->decodedImage();
+        QPointF offset = currentImageOverlay->offset();
+        QRect srcRect = currentImageOverlay->mapFromScene(visPixRect).boundingRect().translated(-offset).toAlignedRect().intersected(decoded.rect());
+        QSize dstSize = (QSizeF(srcRect.size()) / newScale).toSize().expandedTo(QSize(1, 1));
+        QRectF target = currentImageOverlay->mapToScene(QRectF(srcRect).translated(offset)).boundingRect();
 
-        if(newScale > 2.0)
+        if(srcRect.isEmpty())
         {
-            QPixmap imgToScale;
+            return;
+        }
 
-            if(viewportRectScene.contains(currentPixmapOverlay->sceneBoundingRect()))
-            {
-                // the user sees the entire image
-                imgToScale = currentDocumentPixmap;
-            }
-            else // the user sees a part of the image
+        // Scale in the background, as this can take hundreds of milliseconds for huge images. Any change of the viewport supersedes the request.
+        quint64 generation = ++(*this->smoothGeneration);
+        QSharedPointer<std::atomic<quint64>> currentGeneration = this->smoothGeneration;
+        auto promise = std::make_shared<QPromise<QImage>>();
+        this->smoothFuture = promise->future();
+
+        QThreadPool *pool = ANPV::globalInstance()->threadPool();
+        // the other workers of the pool are usually busy decoding
+        int threads = SmoothScaler::threadsPerWorker(pool);
+
+        pool->start([promise, decoded, srcRect, dstSize, generation, currentGeneration, threads]()
+        {
+            promise->start();
+            QImage scaled = SmoothScaler::areaAverage(decoded, srcRect, dstSize, [&]()
             {
-                // the pixmap overlay may have been scaled; we must translate the visible Pixmap Rectangle
-                // (which is in scene coordinates) into the overlay's coordinates
-                QRectF visPixRectMappedToItem = currentPixmapOverlay->mapFromScene(visPixRect).boundingRect();
+                return promise->isCanceled() || currentGeneration->load() != generation;
+            }, threads);
 
-                // now, crop the image to the visible part, so we don't need to scale the entire one
-                imgToScale = currentDocumentPixmap.copy(visPixRectMappedToItem.toAlignedRect());
+            if(!scaled.isNull())
+            {
+                promise->addResult(scaled);
             }
 
-            // Optimization for huge gigapixel images: before applying the smooth transformation, first scale it down to double
-            // window resolution size with fast nearest neighbour transform.
-            QPixmap fastDownScaled = imgToScale.scaled(viewportRect.size() * 2, Qt::KeepAspectRatio, Qt::FastTransformation);
-            QPixmap scaled = fastDownScaled.scaled(viewportRect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            promise->finish();
+        }, static_cast<int>(Priority::Important));
+
+        this->smoothFuture.then(q, [this, generation, target](QFuture<QImage> f)
+        {
+            if(generation != this->smoothGeneration->load() || f.resultCount() == 0)
+            {
+                return;
+            }
 
-            smoothPixmapOverlay->setPos(visPixRect.topLeft());
-            smoothPixmapOverlay->setScale(newScale);
-            smoothPixmapOverlay->setPixmap(scaled);
+            QImage scaled = f.result();
+            smoothPixmapOverlay->setPos(target.topLeft());
+            smoothPixmapOverlay->setTransform(QTransform::fromScale(target.width() / scaled.width(), target.height() / scaled.height()));
+            smoothPixmapOverlay->setPixmap(QPixmap::fromImage(scaled, Qt::NoFormatConversion));
             smoothPixmapOverlay->show();
-            currentPixmapOverlay->hide();
+            currentImageOverlay->hide();
+        });
+    }
+
+    // displays the cached tiles on top of the most recently decoded image, the overlay takes care of painting only the visible ones
+    void showCachedTiles()
+    {
+        tileCacheOverlay->setTileCache(tileCache.get());
+        tileCacheOverlay->show();
+    }
+
+    // splits the image that has just been decoded into tiles for later reuse
+    void cacheDecodedImage()
+    {
+        if(latestDecodingState == DecodingState::FullImage)
+        {
+            // the entire image is displayed anyway
+            return;
         }
-        else
+
+        QImage decoded = currentImageDecoder->image()->decodedImage();
+
+        if(decoded.isNull())
         {
-            qDebug() << "Skipping smooth pixmap scaling: Too far zoomed in";
+            return;
         }
+
+        this->ensureTileCache();
+        tileCache->insert(decoded, currentImageOverlay->transform());
+        tileCacheOverlay->update();
+    }
+
+    void ensureTileCache()
+    {
+        QRect fullResRect = this->currentImageDecoder->image()->fullResolutionRect();
+
+        if(!this->tileCache || this->tileCache->fullResolutionRect() != fullResRect)
+        {
+            bool shown = this->tileCacheOverlay->tileCache() != nullptr;
+            this->tileCacheOverlay->setTileCache(nullptr);
+            this->tileCache = std::make_unique<TileCache>(fullResRect, TileCacheBudget);
+
+            if(shown)
+            {
+                this->tileCacheOverlay->setTileCache(this->tileCache.get());
+            }
+        }
+    }
+
+    bool isTaskStale() const
+    {
+        return this->taskGeneration != this->decodeGeneration;
+    }
+
+    // Cancels the running task without waiting for it. Returns true if it has finished already.
+    bool cancelTask()
+    {
+        if(!this->isTaskFinished())
+        {
+            this->currentImageDecoder->cancelOrTake(this->taskFuture.future());
+        }
+
+        return this->isTaskFinished();
     }
 
     void startImageDecoding()
@@ -292,8 +536,22 @@ struct DocumentView::Impl
             return;
         }
 
-        currentImageDecoder->cancelOrTake(taskFuture.future());
-        taskFuture.waitForFinished();
+        if(this->metadataPending)
+        {
+            // the decoder is busy, onMetadataDecoded() will trigger us again
+            return;
+        }
+
+        if(this->prefetchAdopted && !this->isTaskFinished())
+        {
+            // the prefetch of this image is about to finish, take its result first rather than cancelling it
+            this->restartPending = true;
+            return;
+        }
+
+        // supersede whatever is running
+        this->decodeGeneration++;
+        this->restartPending = false;
 
         // get the area of what the user sees
         QRect viewportRect = q->viewport()->rect();
@@ -301,7 +559,8 @@ struct DocumentView::Impl
         // and map that rect to scene coordinates
         QRectF viewportRectScene = q->mapToScene(viewportRect).boundingRect();
 
-        QFuture<DecodingState> fut;
+        QSize desiredRes = viewportRect.size();
+        QRect roiRect;
         QRect fullResRect = this->currentImageDecoder->image()->fullResolutionRect();
 
         if(!fullResRect.isEmpty())
@@ -313,16 +572,47 @@ struct DocumentView::Impl
             // (which is in scene coordinates) into the view's coordinates
             QRectF visPixRectMappedToView = q->mapFromScene(visPixRect).boundingRect();
 
-            QSize desiredRes = visPixRectMappedToView.toAlignedRect().size();
+            desiredRes = visPixRectMappedToView.toAlignedRect().size();
+
+            if(visPixRect.isEmpty() || desiredRes.isEmpty())
+            {
+                this->cancelTask();
+                return;
+            }
+
+            this->ensureTileCache();
+
+            // only decode those tiles that we don't have yet
+            double scale = std::max(desiredRes.width() / visPixRect.width(), desiredRes.height() / visPixRect.height());
+            int level = TileCache::levelForScale(scale);
+            this->showCachedTiles();
+            QRect missingRect = this->tileCache->missingRect(visPixRect.toAlignedRect(), level);
 
-            fut = this->currentImageDecoder->decodeAsync(DecodingState::PreviewImage, Priority::Important, desiredRes, visPixRect.toAlignedRect());
-            qDebug() << "startImageDecoding(): desiredRes: " << desiredRes << " | visPixRect: " << visPixRect.toAlignedRect();
+            if(missingRect.isEmpty())
+            {
+                qDebug() << "startImageDecoding(): all tiles of visPixRect " << visPixRect.toAlignedRect() << " cached at level " << level;
+                this->cancelTask();
+                return;
+            }
+
+            // decode at the resolution of the level, so that the result can be stored in that level
+            desiredRes = QSize(static_cast<int>(std::ceil(missingRect.width() / double(1 << level))), static_cast<int>(std::ceil(missingRect.height() / double(1 << level))));
+            roiRect = missingRect;
+            qDebug() << "startImageDecoding(): desiredRes: " << desiredRes << " | missingRect: " << missingRect << " | visPixRect: " << visPixRect.toAlignedRect();
         }
-        else
+
+        if(!this->cancelTask())
         {
-            fut = this->currentImageDecoder->decodeAsync(DecodingState::PreviewImage, Priority::Important, viewportRect.size(), QRect());
+            // Never block the UI thread until the decoder has noticed the cancellation, which may take a while for some formats.
+            // Instead restart once it has finished, by which time the viewport may have changed again.
+            this->restartPending = true;
+            return;
         }
 
+        QFuture<DecodingState> fut = this->currentImageDecoder->decodeAsync(DecodingState::PreviewImage, Priority::Important, desiredRes, roiRect);
+        this->taskGeneration = this->decodeGeneration;
+        this->taskRetired = false;
+
         decodeTimer.start();
         this->taskFuture.setFuture(fut);
     }
@@ -332,6 +622,85 @@ struct DocumentView::Impl
         this->startImageDecoding();
     }
 
+    // Decodes the early metadata in the background, while showing the thumbnail or a placeholder.
+    // The image is shown by onMetadataDecoded() once done.
+    void startMetadataDecoding(const QSharedPointer<Image> &img)
+    {
+        if(this->metadataPending)
+        {
+            return;
+        }
+
+        QImage thumb = img->thumbnail();
+
+        if(!thumb.isNull())
+        {
+            // without knowing the full resolution, the best we can do is to show the thumbnail in its own size
+            q->setSceneRect(QRectF(QPointF(0, 0), thumb.size()));
+            thumbnailPreviewOverlay->setPixmap(QPixmap::fromImage(thumb, Qt::NoFormatConversion));
+            thumbnailPreviewOverlay->setTransform(QTransform());
+            thumbnailPreviewOverlay->show();
+        }
+
+        messageWidget->setText(QString("Loading %1 ...").arg(img->fileInfo().fileName()));
+        messageWidget->setMessageType(MessageWidget::MessageType::Information);
+        messageWidget->setIcon(QIcon::fromTheme("image-loading"));
+        messageWidget->show();
+        this->centerMessageWidget(q->size());
+
+        quint64 generation = ++this->metadataGeneration;
+        this->metadataPending = true;
+        this->metadataFuture = this->currentImageDecoder->decodeAsync(DecodingState::Metadata, Priority::Important, q->viewport()->rect().size(), QRect());
+        this->metadataFuture.then(q, [this, img, generation](DecodingState state)
+        {
+            this->onMetadataDecoded(img, state, generation);
+        }).onCanceled(q, [this, generation]()
+        {
+            // continuations are skipped for cancelled futures, without this the decoding could never be started again
+            if(generation == this->metadataGeneration)
+            {
+                this->metadataPending = false;
+            }
+        });
+    }
+
+    void onMetadataDecoded(const QSharedPointer<Image> &img, DecodingState state, quint64 generation)
+    {
+        xThreadGuard g(q);
+
+        if(!this->metadataPending || generation != this->metadataGeneration || !this->currentImageDecoder || this->currentImageDecoder->image() != img)
+        {
+            // the image has been changed in the meantime
+            return;
+        }
+
+        this->metadataPending = false;
+
+        if(state == DecodingState::Error || state == DecodingState::Fatal)
+        {
+            QString name = img->fileInfo().fileName();
+            this->setDocumentError(QString("Decoder failed to retrieve early metadata for file %1, error was %2").arg(name).arg(img->errorMessage()));
+            return;
+        }
+
+        if(state == DecodingState::Cancelled)
+        {
+            return;
+        }
+
+        if(!img->size().isValid())
+        {
+            this->setDocumentError(QStringLiteral("Oops: Early metadata didn't report full image size, but no error was reported?!"));
+            return;
+        }
+
+        this->setDocumentError(QString());
+        // the image may already have been shown by onDecodingStateChanged(), in which case this only refreshes the overlays
+        q->showImage(img);
+        // any decoding requested in the meantime has been skipped
+        this->forceTriggerDecoding();
+    }
+
     void addThumbnailPreview(QSharedPointer<Image> img)
     {
         QImage thumb = img->thumbnail();
@@ -454,6 +823,14 @@ struct DocumentView::Impl
         if(this->currentImageDecoder && this->model)
         {
             QSharedPointer<Image> newEntry = this->model->goTo(this->cachedViewFlags, this->currentImageDecoder->image().get(), i);
+            int direction = (i < 0) ? -1 : 1;
+
+            if(direction != this->navigationDirection)
+            {
+                // apart from the one we're going to, the images prefetched so far are not going to be needed
+                this->evictAllPrefetches(newEntry.get());
+                this->navigationDirection = direction;
+            }
 
             if(newEntry)
             {
@@ -692,14 +1069,19 @@ struct DocumentView::Impl
                     QString targetDir = act->data().toString();
                     QFileInfo source = this->currentImageDecoder->image()->fileInfo();
 
+                    // Loading the next image cancels any pending decoding without waiting for it. The file is moved or deleted once the decoder
+                    // has finished, to release the file handle and avoid a "File being used by other process" error on Windows.
+                    QSharedPointer<SmartImageDecoder> dec = this->currentImageDecoder;
+                    QFuture<DecodingState> running = this->runningFuture();
+
                     switch(op)
                     {
                     case ANPV::FileOperation::Move:
-                        // cancel any pending decoding to release the file handle and avoid a "File being used by other process" error on Windows
-                        this->currentImageDecoder->cancelOrTake(this->taskFuture.future());
-                        this->taskFuture.waitForFinished();
-                        ANPV::globalInstance()->moveFiles({source.fileName()}, source.absoluteDir().absolutePath(), std::move(targetDir));
                         q->loadImage(nextImg);
+                        whenDecoderFinished(dec, running, [source, targetDir]() mutable
+                        {
+                            ANPV::globalInstance()->moveFiles({source.fileName()}, source.absoluteDir().absolutePath(), std::move(targetDir));
+                        });
                         break;
 
                     case ANPV::FileOperation::HardLink:
@@ -707,11 +1089,11 @@ struct DocumentView::Impl
                         break;
 
                     case ANPV::FileOperation::Delete:
-                        // cancel any pending decoding to release the file handle and avoid a "File being used by other process" error on Windows
-                        this->currentImageDecoder->cancelOrTake(this->taskFuture.future());
-                        this->taskFuture.waitForFinished();
-                        ANPV::globalInstance()->deleteFiles({ source.fileName() }, source.absoluteDir().absolutePath());
                         q->loadImage(nextImg);
+                        whenDecoderFinished(dec, running, [source]()
+                        {
+                            ANPV::globalInstance()->deleteFiles({ source.fileName() }, source.absoluteDir().absolutePath());
+                        });
                         break;
 
                     default:
@@ -725,6 +1107,347 @@ struct DocumentView::Impl
         });
     }
 
+    // Starts decoding the neighbours of the current image in the background, so that they can be displayed instantly when navigated to.
+    void schedulePrefetch()
+    {
+        if(!this->model || !this->currentImageDecoder)
+        {
+            return;
+        }
+
+        Image *current = this->currentImageDecoder->image().get();
+        std::vector<QSharedPointer<Image>> wanted;
+
+        auto addNeighbours = [&](int count, int direction)
+        {
+            for(int i = 1; i <= count; i++)
+            {
+                QSharedPointer<Image> img = this->model->goTo(this->cachedViewFlags, current, direction * i);
+
+                if(!img)
+                {
+                    break;
+                }
+
+                if(img.get() != current && std::find(wanted.begin(), wanted.end(), img) == wanted.end())
+                {
+                    wanted.push_back(img);
+                }
+            }
+        };
+
+        addNeighbours(this->prefetchAhead, this->navigationDirection);
+        addNeighbours(this->prefetchBehind, -this->navigationDirection);
+
+        std::vector<Prefetch> scheduled;
+        scheduled.reserve(wanted.size());
+
+        for(const QSharedPointer<Image> &img : wanted)
+        {
+            auto it = std::find_if(this->prefetches.begin(), this->prefetches.end(), [&](const Prefetch & p)
+            {
+                return !p.evicted && p.decoder->image() == img;
+            });
+
+            if(it != this->prefetches.end())
+            {
+                scheduled.push_back(std::move(*it));
+                this->prefetches.erase(it);
+                continue;
+            }
+
+            auto dec = QSharedPointer<SmartImageDecoder>(DecoderFactory::globalInstance()->getDecoder(img).release());
+
+            if(!dec)
+            {
+                continue;
+            }
+
+            Prefetch p;
+            p.decoder = dec;
+            p.watcher.reset(new QFutureWatcher<DecodingState>());
+            QFutureWatcher<DecodingState> *w = p.watcher.get();
+            connect(w, &QFutureWatcher<DecodingState>::finished, q, [this, w]()
+            {
+                this->onPrefetchFinished(w);
+            });
+            p.watcher->setFuture(dec->decodeAsync(DecodingState::PreviewImage, Priority::Normal, this->prefetchResolution(img), QRect()));
+            scheduled.push_back(std::move(p));
+        }
+
+        // whatever is left is no longer a neighbour
+        this->evictAllPrefetches();
+        std::move(this->prefetches.begin(), this->prefetches.end(), std::back_inserter(scheduled));
+        this->prefetches = std::move(scheduled);
+    }
+
+    // the resolution needed to display the given image in the current viewport, rounded up to the next level of the tile cache, so its result can be cached
+    QSize prefetchResolution(const QSharedPointer<Image> &img)
+    {
+        QSize viewportSize = q->viewport()->rect().size();
+        QSize fullSize = img->size();
+
+        if(!fullSize.isValid() || viewportSize.isEmpty())
+        {
+            return viewportSize;
+        }
+
+        double scale = std::min(viewportSize.width() * 1.0 / fullSize.width(), viewportSize.height() * 1.0 / fullSize.height());
+        int level = TileCache::levelForScale(scale);
+        return QSize(static_cast<int>(std::ceil(fullSize.width() / double(1 << level))), static_cast<int>(std::ceil(fullSize.height() / double(1 << level))));
+    }
+
+    void releasePrefetch(Prefetch &p)
+    {
+        p.watcher->disconnect(q);
+
+        // the image might have been navigated to in the meantime and is being displayed or prefetched by another decoder
+        if(!this->isImageInUse(p.decoder->image()))
+        {
+            p.decoder->releaseFullImage();
+        }
+    }
+
+    // Marks the prefetch as evicted. If finished, it's released and removed immediately, otherwise it's cancelled and released by onPrefetchFinished().
+    std::vector<Prefetch>::iterator evictPrefetch(std::vector<Prefetch>::iterator it)
+    {
+        it->evicted = true;
+
+        if(it->watcher->isFinished())
+        {
+            this->releasePrefetch(*it);
+            return this->prefetches.erase(it);
+        }
+
+        it->decoder->cancelOrTake(it->watcher->future());
+        return ++it;
+    }
+
+    void evictAllPrefetches(const Image *keep = nullptr)
+    {
+        for(auto it = this->prefetches.begin(); it != this->prefetches.end();)
+        {
+            if(it->evicted || it->decoder->image().get() == keep)
+            {
+                ++it;
+                continue;
+            }
+
+            it = this->evictPrefetch(it);
+        }
+    }
+
+    void onPrefetchFinished(QFutureWatcher<DecodingState> *w)
+    {
+        auto it = std::find_if(this->prefetches.begin(), this->prefetches.end(), [&](const Prefetch & p)
+        {
+            return p.watcher.get() == w;
+        });
+
+        if(it == this->prefetches.end())
+        {
+            return;
+        }
+
+        if(it->evicted)
+        {
+            this->releasePrefetch(*it);
+            this->prefetches.erase(it);
+            return;
+        }
+
+        // keep the most likely images within the budget
+        qint64 bytes = 0;
+
+        for(auto p = this->prefetches.begin(); p != this->prefetches.end();)
+        {
+            if(!p->evicted && p->watcher->isFinished())
+            {
+                qint64 size = p->decoder->image()->decodedImage().sizeInBytes();
+
+                if(bytes + size > this->prefetchBudget)
+                {
+                    qDebug() << "Prefetch budget exceeded, dropping " << p->decoder->image()->fileInfo().fileName();
+                    p->evicted = true;
+                    this->releasePrefetch(*p);
+                    p = this->prefetches.erase(p);
+                    continue;
+                }
+
+                bytes += size;
+            }
+
+            ++p;
+        }
+    }
+
+    // Removes the prefetch of the given image, if it can be displayed right away or is at least far enough to know its size.
+    std::optional<Prefetch> takePrefetch(const QSharedPointer<Image> &img)
+    {
+        auto it = std::find_if(this->prefetches.begin(), this->prefetches.end(), [&](const Prefetch & p)
+        {
+            return !p.evicted && p.decoder->image() == img;
+        });
+
+        if(it == this->prefetches.end())
+        {
+            return std::nullopt;
+        }
+
+        DecodingState state = img->decodingState();
+        bool usable = it->watcher->isFinished()
+                      ? (state == DecodingState::PreviewImage || state == DecodingState::FullImage)
+                      : img->size().isValid();
+
+        if(!usable)
+        {
+            // failed or not even the metadata is known yet, don't bother and get it out of the way of the decoder that is going to display the image
+            this->evictPrefetch(it);
+            return std::nullopt;
+        }
+
+        Prefetch p = std::move(*it);
+        this->prefetches.erase(it);
+        p.watcher->disconnect(q);
+        return p;
+    }
+
+    // takes over the decoding state of a prefetch, after it has been loaded as current image
+    void adoptPrefetch(const Prefetch &p)
+    {
+        if(p.watcher->isFinished())
+        {
+            // the decoded image has been displayed by onImageRefinement() already, make sure it doesn't get decoded once again
+            this->cacheDecodedImage();
+            return;
+        }
+
+        this->taskFuture.setFuture(p.watcher->future());
+        this->taskGeneration = this->decodeGeneration;
+        this->taskRetired = false;
+        this->prefetchAdopted = true;
+        this->decodeTimer.start();
+    }
+
+    // DecodedImageBudget wants the decoded image of img to be released
+    void onEvictionRequested(const Image *img)
+    {
+        for(auto it = this->prefetches.begin(); it != this->prefetches.end(); ++it)
+        {
+            if(!it->evicted && it->decoder->image().get() == img)
+            {
+                this->evictPrefetch(it);
+                break;
+            }
+        }
+
+        if(this->currentImageDecoder && this->currentImageDecoder->image().get() == img)
+        {
+            if(q->isVisible())
+            {
+                // we'll be asked again once hidden
+                DecodedImageBudget::globalInstance()->decline(img);
+            }
+            else
+            {
+                this->evictToPreview();
+            }
+        }
+    }
+
+    bool canEvictToPreview() const
+    {
+        if(this->latestDecodingState != DecodingState::PreviewImage && this->latestDecodingState != DecodingState::FullImage)
+        {
+            return false;
+        }
+
+        // otherwise the decoder still needs the image, it will be asked again once the decoder has updated it
+        return !this->metadataPending && this->isTaskFinished();
+    }
+
+    // Replaces the decoded image by a copy downscaled to the viewport size and releases the decoded image.
+    // The downscaling takes place in the background, as it may take seconds for huge images. The decoding starts over once we're shown again.
+    void evictToPreview()
+    {
+        if(this->evictionFuture.isRunning())
+        {
+            return;
+        }
+
+        if(!this->canEvictToPreview())
+        {
+            DecodedImageBudget::globalInstance()->decline(this->currentImageDecoder->image().get());
+            return;
+        }
+
+        QSharedPointer<Image> img = this->currentImageDecoder->image();
+        QImage decoded = img->decodedImage();
+        QSize previewSize = decoded.size().scaled(q->viewport()->size(), Qt::KeepAspectRatio).boundedTo(decoded.size());
+        QSize decodedSize = decoded.size();
+        QPoint offset = decoded.offset();
+        quint64 generation = this->decodeGeneration;
+
+        QThreadPool *pool = ANPV::globalInstance()->threadPool();
+        int threads = SmoothScaler::threadsPerWorker(pool);
+        auto promise = std::make_shared<QPromise<QImage>>();
+        this->evictionFuture = promise->future();
+
+        pool->start([promise, decoded, previewSize, threads]()
+        {
+            promise->start();
+            QImage preview = SmoothScaler::areaAverage(decoded, decoded.rect(), previewSize, [&]()
+            {
+                return promise->isCanceled();
+            }, threads);
+
+            if(!preview.isNull())
+            {
+                promise->addResult(preview);
+            }
+
+            promise->finish();
+        }, static_cast<int>(Priority::Normal));
+
+        this->evictionFuture.then(q, [this, img, generation, decodedSize, offset](QFuture<QImage> f)
+        {
+            if(f.resultCount() == 0 || generation != this->decodeGeneration || !this->currentImageDecoder || this->currentImageDecoder->image() != img
+                    || q->isVisible() || !this->canEvictToPreview())
+            {
+                // superseded meanwhile, e.g. because we have been shown again
+                DecodedImageBudget::globalInstance()->decline(img.get());
+                return;
+            }
+
+            this->swapInPreview(f.result(), decodedSize, offset);
+        });
+    }
+
+    // releases the decoded image of decodedSize, displaying preview in its place instead
+    void swapInPreview(const QImage &preview, QSize decodedSize, QPoint offset)
+    {
+        QTransform previewToFullRes = QTransform::fromScale(decodedSize.width() / double(preview.width()), decodedSize.height() / double(preview.height()))
+                                      * this->currentImageOverlay->transform();
+
+        this->removeSmoothPixmap();
+        this->tileCacheOverlay->setTileCache(nullptr);
+        this->tileCacheOverlay->hide();
+        this->tileCache.reset();
+        this->previousDecodedImageOverlay->setImage(QImage());
+        this->previousDecodedImageOverlay->hide();
+
+        // this falls back to the Metadata state and clears the currentImageOverlay via onImageRefinement()
+        this->currentImageDecoder->releaseFullImage();
+
+        this->currentDocumentImage = preview;
+        this->currentImageOverlay->setImage(this->currentDocumentImage);
+        this->currentImageOverlay->setTransform(previewToFullRes, false);
+        this->currentImageOverlay->setOffset(this->currentImageOverlay->mapFromScene(offset));
+        this->currentImageOverlay->show();
+
+        this->evictedToPreview = true;
+    }
+
     bool updateIsSelectedCheckBoxEnabledState()
     {
         auto fm = ANPV::globalInstance()->fileModel();
@@ -759,17 +1482,20 @@ DocumentView::DocumentView(QWidget *parent)
     d->thumbnailPreviewOverlay->setZValue(-10);
     d->scene->addItem(d->thumbnailPreviewOverlay);
 
-    d->previousDecodedPixmapOverlay = new QGraphicsPixmapItem;
-    d->previousDecodedPixmapOverlay->setZValue(-9);
-    d->previousDecodedPixmapOverlay->setShapeMode(QGraphicsPixmapItem::BoundingRectShape);
-    d->previousDecodedPixmapOverlay->setTransformationMode(Qt::SmoothTransformation);
-    d->scene->addItem(d->previousDecodedPixmapOverlay);
+    d->previousDecodedImageOverlay = new DecodedImageItem;
+    d->previousDecodedImageOverlay->setZValue(-9);
+    d->previousDecodedImageOverlay->setTransformationMode(Qt::SmoothTransformation);
+    d->scene->addItem(d->previousDecodedImageOverlay);
 
-    d->currentPixmapOverlay = new QGraphicsPixmapItem;
-    d->currentPixmapOverlay->setZValue(-8);
-    d->currentPixmapOverlay->setShapeMode(QGraphicsPixmapItem::BoundingRectShape);
-    d->currentPixmapOverlay->setTransformationMode(Qt::SmoothTransformation);
-    d->scene->addItem(d->currentPixmapOverlay);
+    d->currentImageOverlay = new DecodedImageItem;
+    d->currentImageOverlay->setZValue(-8);
+    d->currentImageOverlay->setTransformationMode(Qt::SmoothTransformation);
+    d->scene->addItem(d->currentImageOverlay);
+
+    // above the currently decoded image, as it's transparent where tiles are missing, i.e. where the decoder is working
+    d->tileCacheOverlay = new TiledImageItem;
+    d->tileCacheOverlay->setZValue(-7.5);
+    d->scene->addItem(d->tileCacheOverlay);
 
     d->smoothPixmapOverlay = new QGraphicsPixmapItem;
     d->smoothPixmapOverlay->setZValue(-7);
@@ -788,6 +1514,23 @@ DocumentView::DocumentView(QWidget *parent)
     d->debugOverlay1->hide();
     connect(&d->taskFuture, &QFutureWatcher<DecodingState>::finished, this, [&]()
         {
+            if(d->taskRetired)
+            {
+                // the task of a previous image, nothing to do
+                return;
+            }
+
+            if(d->isTaskStale())
+            {
+                // superseded by a newer request, drop the results
+                if(d->restartPending)
+                {
+                    d->startImageDecoding();
+                }
+
+                return;
+            }
+
             const QPainterPath* dbg = this->d->currentImageDecoder->imageLayout();
             if (dbg != nullptr)
             {
@@ -796,13 +1539,25 @@ DocumentView::DocumentView(QWidget *parent)
             }
             d->fovChangedTimer.setInterval(std::min(MaxFovTimerInterval, d->decodeTimer.elapsed()));
 
-            d->previousDecodedPixmapOverlay->setTransform(d->currentPixmapOverlay->transform(), false);
-            d->previousDecodedPixmapOverlay->setOffset(d->currentPixmapOverlay->offset());
-            d->previousDecodedPixmapOverlay->setPixmap(d->currentPixmapOverlay->pixmap());
-            d->previousDecodedPixmapOverlay->show();
+            if(!d->taskFuture.isCanceled() && d->taskFuture.result() == DecodingState::PreviewImage)
+            {
+                d->cacheDecodedImage();
+            }
+
+            d->previousDecodedImageOverlay->setTransform(d->currentImageOverlay->transform(), false);
+            d->previousDecodedImageOverlay->setOffset(d->currentImageOverlay->offset());
+            d->previousDecodedImageOverlay->setImage(d->currentImageOverlay->image());
+            d->previousDecodedImageOverlay->show();
 
             // invalidate background of graphicsview
             this->invalidateScene(QRectF(), QGraphicsScene::BackgroundLayer);
+
+            d->prefetchAdopted = false;
+
+            if(d->restartPending)
+            {
+                d->startImageDecoding();
+            }
         });
 
     connect(&d->taskFuture, &QFutureWatcher<DecodingState>::started, this, [&]()
@@ -869,12 +1624,23 @@ DocumentView::DocumentView(QWidget *parent)
     {
         d->onViewModeChanged(neu);
     });
+
+    connect(DecodedImageBudget::globalInstance(), &DecodedImageBudget::evictionRequested, this,
+            [&](const Image *img)
+    {
+        d->onEvictionRequested(img);
+    });
 }
 
 DocumentView::~DocumentView() = default;
 
 void DocumentView::setModel(QSharedPointer<ImageSectionDataContainer> model)
 {
+    if(d->model != model)
+    {
+        d->evictAllPrefetches();
+    }
+
     d->model = model;
     d->updateIsSelectedCheckBoxEnabledState();
 }
@@ -936,6 +1702,27 @@ void DocumentView::scrollContentsBy(int dx, int dy)
 void DocumentView::showEvent(QShowEvent *event)
 {
     QGraphicsView::showEvent(event);
+
+    if(d->currentImageDecoder)
+    {
+        DecodedImageBudget::globalInstance()->touch(d->currentImageDecoder->image().get());
+        // no need to evict anymore
+        d->evictionFuture.cancel();
+
+        if(d->evictedToPreview)
+        {
+            d->evictedToPreview = false;
+            d->forceTriggerDecoding();
+        }
+    }
+}
+
+void DocumentView::hideEvent(QHideEvent *event)
+{
+    QGraphicsView::hideEvent(event);
+
+    // the decoded image may not have been released while we were visible
+    DecodedImageBudget::globalInstance()->enforceLimit();
 }
 
 void DocumentView::resizeEvent(QResizeEvent *event)
@@ -1012,32 +1799,31 @@ void DocumentView::mouseMoveEvent(QMouseEvent *event)
 
 void DocumentView::onPreviewImageUpdated(Image *img, QRect r)
 {
-    if(img != this->d->currentImageDecoder->image().data() || !d->currentPixmapOverlay || d->currentPixmapOverlay->pixmap().isNull())
+    if(img != this->d->currentImageDecoder->image().data() || !d->currentImageOverlay || d->currentImageOverlay->image().isNull() || d->isTaskStale())
     {
-        // ignore events from a previous decoder that might still be running in the background
+        // ignore events from a previous decoder that might still be running in the background, or from a superseded task
         return;
     }
 
-    // assert that the update rect is inside the boundingBox of the pixmapOverlay
-    QRectF bound = d->currentPixmapOverlay->boundingRect();
-    QRect algBound = bound.toAlignedRect();
-    Q_ASSERT(algBound.contains(r));
-    d->currentPixmapOverlay->update(r);
+    // assert that the update rect is inside the decoded image
+    Q_ASSERT(d->currentImageOverlay->image().rect().contains(r));
+    d->currentImageOverlay->updateImageRect(r);
 }
 
 void DocumentView::onImageRefinement(Image *img, QImage image, QTransform scale)
 {
-    if(img != this->d->currentImageDecoder->image().data())
+    if(img != this->d->currentImageDecoder->image().data() || d->isTaskStale())
     {
-        // ignore events from a previous decoder that might still be running in the background
+        // ignore events from a previous decoder that might still be running in the background, or from a superseded task
         return;
     }
 
-    d->currentDocumentPixmap = QPixmap::fromImage(image, Qt::NoFormatConversion);
-    d->currentPixmapOverlay->setPixmap(d->currentDocumentPixmap);
-    d->currentPixmapOverlay->setTransform(scale, false);
-    d->currentPixmapOverlay->setOffset(d->currentPixmapOverlay->mapFromScene(image.offset()));
-    d->currentPixmapOverlay->show();
+    // share the buffer the decoder writes to, rather than copying it into a QPixmap
+    d->currentDocumentImage = image;
+    d->currentImageOverlay->setImage(d->currentDocumentImage);
+    d->currentImageOverlay->setTransform(scale, false);
+    d->currentImageOverlay->setOffset(d->currentImageOverlay->mapFromScene(image.offset()));
+    d->currentImageOverlay->show();
 
     d->scene->invalidate();
 }
@@ -1064,6 +1850,7 @@ void DocumentView::onDecodingStateChanged(Image *img, quint32 newState, quint32
 
     case DecodingState::FullImage:
         d->thumbnailPreviewOverlay->hide();
+        d->tileCacheOverlay->hide();
         this->update();
         [[fallthrough]];
 
@@ -1074,7 +1861,7 @@ void DocumentView::onDecodingStateChanged(Image *img, quint32 newState, quint32
 
     case DecodingState::Fatal:
     case DecodingState::Error:
-        d->currentDocumentPixmap = QPixmap();
+        d->currentDocumentImage = QImage();
         d->setDocumentError(dec->image());
         [[fallthrough]];
 
@@ -1125,6 +1912,15 @@ void DocumentView::loadImage(QString url)
 
 void DocumentView::loadImage(QSharedPointer<Image> image)
 {
+    auto prefetch = d->takePrefetch(image);
+
+    if(prefetch)
+    {
+        this->loadImage(prefetch->decoder);
+        d->adoptPrefetch(*prefetch);
+        return;
+    }
+
     auto dec = QSharedPointer<SmartImageDecoder>(DecoderFactory::globalInstance()->getDecoder(image).release());
 
     if(!dec)
@@ -1153,7 +1949,9 @@ void DocumentView::loadImage(const QSharedPointer<SmartImageDecoder> &dec)
     }
 
     d->updateIsSelectedCheckBoxEnabledState();
+    DecodedImageBudget::globalInstance()->touch(d->owningRefToImage.get());
     this->loadImage();
+    d->schedulePrefetch();
 }
 
 void DocumentView::showImage(QSharedPointer<Image> img)
@@ -1164,79 +1962,61 @@ void DocumentView::showImage(QSharedPointer<Image> img)
 
     if(!fullImgSize.isValid())
     {
-        // this can happen if the image has been yet started decoding
-        auto fut = d->currentImageDecoder->decodeAsync(DecodingState::Metadata, Priority::Important, this->viewport()->rect().size(), QRect());
-        fut.waitForFinished();
-        auto state = fut.result();
+        // this can happen if the image has not yet started decoding
+        d->startMetadataDecoding(img);
+        return;
+    }
 
-        if(state == DecodingState::Error || state == DecodingState::Fatal)
-        {
-            QString name = img->fileInfo().fileName();
-            d->setDocumentError(QString("Decoder failed to retrieve early metadata for file %1, error was %2").arg(name).arg(img->errorMessage()));
-            return;
-        }
+    this->setSceneRect(QRectF(QPointF(0, 0), fullImgSize));
 
-        fullImgSize = img->size();
+    if(d->latestDecodingState < DecodingState::Metadata)
+    {
+        d->latestDecodingState = DecodingState::Metadata;
 
-        if(!fullImgSize.isValid())
-        {
-            throw std::logic_error("Oops: Early metadata didn't report full image size, but no error was reported?!");
-        }
-    }
+        d->alignImageAccordingToViewMode(img, ANPV::globalInstance()->viewMode());
 
-    if(fullImgSize.isValid())
-    {
-        this->setSceneRect(QRectF(QPointF(0, 0), fullImgSize));
+        auto viewFlags = ANPV::globalInstance()->viewFlags();
+        auto afp = img->cachedAutoFocusPoints();
 
-        if(d->latestDecodingState < DecodingState::Metadata)
+        if(afp)
         {
-            d->latestDecodingState = DecodingState::Metadata;
-
-            d->alignImageAccordingToViewMode(img, ANPV::globalInstance()->viewMode());
+            double rotationOut = 0;
+            img->exif()->autoFocusRotation(rotationOut);
 
-            auto viewFlags = ANPV::globalInstance()->viewFlags();
-            auto afp = img->cachedAutoFocusPoints();
+            std::vector<AfPoint> &afPoints = std::get<0>(*afp);
+            QSize &size = std::get<1>(*afp);
+            d->afPointOverlay->setVisible((ANPV::globalInstance()->viewFlags() & static_cast<ViewFlags_t>(ViewFlag::ShowAfPoints)) != 0);
+            d->afPointOverlay->setAfPoints(afPoints, size, -rotationOut);
 
-            if(afp)
+            if(viewFlags & static_cast<ViewFlags_t>(ViewFlag::CenterAf))
             {
-                double rotationOut = 0;
-                img->exif()->autoFocusRotation(rotationOut);
-
-                std::vector<AfPoint> &afPoints = std::get<0>(*afp);
-                QSize &size = std::get<1>(*afp);
-                d->afPointOverlay->setVisible((ANPV::globalInstance()->viewFlags() & static_cast<ViewFlags_t>(ViewFlag::ShowAfPoints)) != 0);
-                d->afPointOverlay->setAfPoints(afPoints, size, -rotationOut);
+                QRect inFocusBoundingRect;
+                QRect selectedFocusBoundingRect;
 
-                if(viewFlags & static_cast<ViewFlags_t>(ViewFlag::CenterAf))
+                for(size_t i = 0; i < afPoints.size(); i++)
                 {
-                    QRect inFocusBoundingRect;
-                    QRect selectedFocusBoundingRect;
+                    auto &af = afPoints[i];
+                    auto type = std::get<0>(af);
+                    auto rect = std::get<1>(af);
 
-                    for(size_t i = 0; i < afPoints.size(); i++)
+                    if(type == AfType::HasFocus)
                     {
-                        auto &af = afPoints[i];
-                        auto type = std::get<0>(af);
-                        auto rect = std::get<1>(af);
-
-                        if(type == AfType::HasFocus)
-                        {
-                            inFocusBoundingRect = inFocusBoundingRect.united(rect);
-                        }
-                        else if(type == AfType::Selected)
-                        {
-                            selectedFocusBoundingRect = selectedFocusBoundingRect.united(rect);
-                        }
-                    }
-
-                    if(inFocusBoundingRect.isValid())
-                    {
-                        this->centerOn(inFocusBoundingRect.center());
+                        inFocusBoundingRect = inFocusBoundingRect.united(rect);
                     }
-                    else if(selectedFocusBoundingRect.isValid())
+                    else if(type == AfType::Selected)
                     {
-                        this->centerOn(selectedFocusBoundingRect.center());
+                        selectedFocusBoundingRect = selectedFocusBoundingRect.united(rect);
                     }
                 }
+
+                if(inFocusBoundingRect.isValid())
+                {
+                    this->centerOn(inFocusBoundingRect.center());
+                }
+                else if(selectedFocusBoundingRect.isValid())
+                {
+                    this->centerOn(selectedFocusBoundingRect.center());
+                }
             }
         }
     }
@@ -1275,7 +2055,10 @@ void DocumentView::readSettings(QSettings& settings)
     d->actionShowInfoBox->setChecked(settings.value("showInfoBox", true).toBool());
     d->actionShowScrollBars->setChecked(settings.value("showScrollBars", true).toBool());
     d->actionPeriodicBoundary->setChecked(settings.value("periodicBoundary", false).toBool());
-    
+    d->prefetchAhead = std::max(0, settings.value("prefetchAhead", DefaultPrefetchAhead).toInt());
+    d->prefetchBehind = std::max(0, settings.value("prefetchBehind", DefaultPrefetchBehind).toInt());
+    d->prefetchBudget = qint64(std::max(0, settings.value("prefetchBudgetMiB", DefaultPrefetchBudgetMiB).toInt())) * 1024 * 1024;
+
     QColor col = settings.value("sceneBackgroundColor", d->scene->backgroundBrush().color()).value<QColor>();
     d->scene->setBackgroundBrush(QBrush(col));
 }
@@ -1286,6 +2069,9 @@ void DocumentView::writeSettings(QSettings& settings)
     settings.setValue("showInfoBox", d->actionShowInfoBox->isChecked());
     settings.setValue("showScrollBars", d->actionShowScrollBars->isChecked());
     settings.setValue("periodicBoundary", d->actionPeriodicBoundary->isChecked());
+    settings.setValue("prefetchAhead", d->prefetchAhead);
+    settings.setValue("prefetchBehind", d->prefetchBehind);
+    settings.setValue("prefetchBudgetMiB", static_cast<int>(d->prefetchBudget / 1024 / 1024));
     settings.setValue("sceneBackgroundColor", d->scene->backgroundBrush().color());
 }
 
@@ -1297,7 +2083,7 @@ void DocumentView::drawBackground(QPainter* painter, const QRectF& rect)
     QGraphicsView::drawBackground(painter, rect);
 
     // Tile the image if it's smaller than the viewport
-    const QPixmap& pix = d->currentDocumentPixmap;
+    const QImage& pix = d->currentDocumentImage;
     if ((d->cachedViewFlags & static_cast<ViewFlags_t>(ViewFlag::PeriodicBoundary)) == 0 || pix.isNull())
     {
         return;
@@ -1323,7 +2109,7 @@ void DocumentView::drawBackground(QPainter* painter, const QRectF& rect)
 
     // Use the item's scene transform so the painter draws in item-local coordinates
     // and respects any scaling applied to the overlay item.
-    QTransform itemToScene = d->currentPixmapOverlay->sceneTransform();
+    QTransform itemToScene = d->currentImageOverlay->sceneTransform();
     bool invertible = true;
     QTransform sceneToItem = itemToScene.inverted(&invertible);
     if (!invertible)
@@ -1333,7 +2119,7 @@ void DocumentView::drawBackground(QPainter* painter, const QRectF& rect)
     }
 
     // Offset of the pixmap inside the item in item coords
-    QPointF offset = d->currentPixmapOverlay->offset();
+    QPointF offset = d->currentImageOverlay->offset();
 
     // Work in item-local coordinates by setting the painter transform to the item's sceneTransform
     painter->setTransform(itemToScene, /*combine=*/true);
@@ -1397,7 +2183,7 @@ void DocumentView::drawBackground(QPainter* painter, const QRectF& rect)
 
             // Destination rect (expanded by epsX/epsY to ensure a 1-device-pixel overlap)
             QRectF destRect(-epsX, -epsY/2.0, pw + 2*epsX, ph + 2*epsY);
-            painter->drawPixmap(destRect, pix, pix.rect());
+            painter->drawImage(destRect, pix, pix.rect());
             painter->restore();
         }
     }
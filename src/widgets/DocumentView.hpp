@@ -17,6 +17,7 @@ class QPixmap;
 class QWheelEvent;
 class QMouseEvent;
 class QShowEvent;
+class QHideEvent;
 class QEvent;
 class SmartImageDecoder;
 class ImageSectionDataContainer;
@@ -56,6 +57,7 @@ protected:
     void resizeEvent(QResizeEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
     void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
     void scrollContentsBy(int dx, int dy) override;
     void drawBackground(QPainter* painter, const QRectF& rect) override;
 
@@ -5,6 +5,7 @@
 #include "SortedImageModel.hpp"
 #include "WaitCursor.hpp"
 #include "ANPV.hpp"
+#include "DecodedImageBudget.hpp"
 
 #include <QTabWidget>
 #include <QSharedPointer>
@@ -14,6 +15,8 @@
 #include <QActionGroup>
 #include <QPointer>
 
+#include <algorithm>
+
 struct MultiDocumentView::Impl
 {
     MultiDocumentView *q;
@@ -45,6 +48,7 @@ struct MultiDocumentView::Impl
         auto &settings = ANPV::globalInstance()->settings();
         settings.beginGroup("MultiDocumentView");
         settings.setValue("geometry", q->saveGeometry());
+        settings.setValue("decodedImageBudgetMiB", DecodedImageBudget::globalInstance()->limit() / (1024 * 1024));
         settings.endGroup();
         
         auto dv = dynamic_cast<DocumentView*>(this->tw->currentWidget());
@@ -71,6 +75,10 @@ struct MultiDocumentView::Impl
 
         QByteArray settingsGeo = settings.value("geometry", parentGeo).toByteArray();
         q->restoreGeometry(settingsGeo);
+
+        // the total size of decoded images of all tabs, beyond which inactive tabs fall back to a preview
+        qint64 budgetMiB = settings.value("decodedImageBudgetMiB", DecodedImageBudget::DefaultLimitMiB).toLongLong();
+        DecodedImageBudget::globalInstance()->setLimit(std::max<qint64>(budgetMiB, 64) * 1024 * 1024);
         settings.endGroup();
     }
 
@@ -0,0 +1,377 @@
+
+#include "ThumbnailLayout.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace
+{
+// width of items that need to be queried
+constexpr int Unknown = std::numeric_limits<int>::min();
+// value of firstDirty if nothing needs to be flown again
+constexpr int Clean = std::numeric_limits<int>::max();
+}
+
+struct ThumbnailLayout::Impl
+{
+    struct Row
+    {
+        // index of the first item
+        int first;
+        int y;
+        int height;
+    };
+
+    int viewportWidth = 0;
+    int rowHeight = 0;
+    int sectionHeight = 0;
+    int spacing = 0;
+
+    std::vector<int> widths;
+    std::vector<int> xs;
+    // sorted by their first item as well as by their position
+    std::vector<Row> rows;
+    int contentHeight = 0;
+
+    // items starting from the row of this one need to be flown again
+    int firstDirty = Clean;
+
+    void markDirty(int item)
+    {
+        this->firstDirty = std::min(this->firstDirty, item);
+    }
+
+    void setGeometry(int &member, int value)
+    {
+        if(member != value)
+        {
+            member = value;
+            this->markDirty(0);
+        }
+    }
+
+    int count() const
+    {
+        return static_cast<int>(this->widths.size());
+    }
+
+    size_t rowOf(int item) const
+    {
+        auto it = std::upper_bound(this->rows.begin(), this->rows.end(), item, [](int i, const Row & r)
+        {
+            return i < r.first;
+        });
+
+        return it == this->rows.begin() ? 0 : static_cast<size_t>(it - this->rows.begin()) - 1;
+    }
+
+    size_t rowAt(int y) const
+    {
+        auto it = std::upper_bound(this->rows.begin(), this->rows.end(), y, [](int y, const Row & r)
+        {
+            return y < r.y;
+        });
+
+        return it == this->rows.begin() ? 0 : static_cast<size_t>(it - this->rows.begin()) - 1;
+    }
+
+    // one past the last item of row r
+    int rowEnd(size_t r) const
+    {
+        return r + 1 < this->rows.size() ? this->rows[r + 1].first : this->count();
+    }
+
+    void flow(const std::function<int(int)> &widthOf)
+    {
+        const int n = this->count();
+
+        if(n == 0)
+        {
+            this->rows.clear();
+            this->xs.clear();
+            this->contentHeight = 0;
+            return;
+        }
+
+        // Everything before the row preceding the first changed item stays as it is. The preceding row is included,
+        // as the changed item might start a row and fit into the preceding one now.
+        size_t r = this->rows.empty() ? 0 : this->rowOf(std::min(this->firstDirty, n - 1));
+        r = r > 0 ? r - 1 : 0;
+        int item = r < this->rows.size() ? this->rows[r].first : 0;
+        int y = r < this->rows.size() ? this->rows[r].y : this->spacing;
+
+        this->rows.resize(r);
+        this->xs.resize(n);
+
+        int x = this->spacing;
+        bool rowOpen = false;
+
+        for(int i = item; i < n; i++)
+        {
+            if(this->widths[i] == Unknown)
+            {
+                this->widths[i] = widthOf(i);
+            }
+
+            if(this->widths[i] == Section)
+            {
+                if(rowOpen)
+                {
+                    y += this->rowHeight + this->spacing;
+                    rowOpen = false;
+                }
+
+                this->rows.push_back(Row{i, y, this->sectionHeight});
+                this->xs[i] = this->spacing;
+                y += this->sectionHeight + this->spacing;
+                continue;
+            }
+
+            const int w = std::max(0, this->widths[i]);
+
+            // wrap, unless the item would be the first one of the row anyway
+            if(!rowOpen || (x > this->spacing && x + w + this->spacing > this->viewportWidth))
+            {
+                if(rowOpen)
+                {
+                    y += this->rowHeight + this->spacing;
+                }
+
+                this->rows.push_back(Row{i, y, this->rowHeight});
+                x = this->spacing;
+                rowOpen = true;
+            }
+
+            this->xs[i] = x;
+            x += w + this->spacing;
+        }
+
+        if(rowOpen)
+        {
+            y += this->rowHeight + this->spacing;
+        }
+
+        this->contentHeight = y;
+    }
+};
+
+ThumbnailLayout::ThumbnailLayout() : d(std::make_unique<Impl>())
+{
+}
+
+ThumbnailLayout::~ThumbnailLayout() = default;
+
+void ThumbnailLayout::setViewportWidth(int width)
+{
+    d->setGeometry(d->viewportWidth, width);
+}
+
+void ThumbnailLayout::setRowHeight(int height)
+{
+    d->setGeometry(d->rowHeight, height);
+}
+
+void ThumbnailLayout::setSectionHeight(int height)
+{
+    d->setGeometry(d->sectionHeight, height);
+}
+
+void ThumbnailLayout::setSpacing(int spacing)
+{
+    d->setGeometry(d->spacing, spacing);
+}
+
+void ThumbnailLayout::reset(int count)
+{
+    d->widths.assign(count, Unknown);
+    d->xs.assign(count, d->spacing);
+    d->rows.clear();
+    d->contentHeight = 0;
+    d->firstDirty = 0;
+}
+
+void ThumbnailLayout::insertItems(int first, int count)
+{
+    if(count <= 0 || first < 0 || first > d->count())
+    {
+        return;
+    }
+
+    d->widths.insert(d->widths.begin() + first, count, Unknown);
+    d->xs.insert(d->xs.begin() + std::min<size_t>(first, d->xs.size()), count, d->spacing);
+
+    for(auto &row : d->rows)
+    {
+        if(row.first > first)
+        {
+            row.first += count;
+        }
+    }
+
+    d->markDirty(first);
+}
+
+void ThumbnailLayout::removeItems(int first, int count)
+{
+    count = std::min(count, d->count() - first);
+
+    if(count <= 0 || first < 0)
+    {
+        return;
+    }
+
+    d->widths.erase(d->widths.begin() + first, d->widths.begin() + first + count);
+
+    if(static_cast<size_t>(first) < d->xs.size())
+    {
+        d->xs.erase(d->xs.begin() + first, d->xs.begin() + std::min<size_t>(first + count, d->xs.size()));
+    }
+
+    for(auto &row : d->rows)
+    {
+        if(row.first >= first + count)
+        {
+            row.first -= count;
+        }
+        else if(row.first > first)
+        {
+            // the row loses all of its items up to the removed range
+            row.first = first;
+        }
+    }
+
+    // drop rows that became empty
+    auto last = std::unique(d->rows.begin(), d->rows.end(), [](const Impl::Row & a, const Impl::Row & b)
+    {
+        return a.first == b.first;
+    });
+    last = std::remove_if(d->rows.begin(), last, [this](const Impl::Row & r)
+    {
+        return r.first >= d->count();
+    });
+    d->rows.erase(last, d->rows.end());
+
+    d->markDirty(first);
+}
+
+void ThumbnailLayout::invalidate(int first, int last)
+{
+    first = std::max(first, 0);
+    last = std::min(last, d->count() - 1);
+
+    if(first > last)
+    {
+        return;
+    }
+
+    std::fill(d->widths.begin() + first, d->widths.begin() + last + 1, Unknown);
+    d->markDirty(first);
+}
+
+void ThumbnailLayout::invalidateAll()
+{
+    this->invalidate(0, d->count() - 1);
+}
+
+bool ThumbnailLayout::isDirty() const
+{
+    return d->firstDirty != Clean;
+}
+
+void ThumbnailLayout::layout(const std::function<int(int)> &widthOf)
+{
+    if(this->isDirty())
+    {
+        d->flow(widthOf);
+        d->firstDirty = Clean;
+    }
+}
+
+int ThumbnailLayout::count() const
+{
+    return d->count();
+}
+
+int ThumbnailLayout::contentHeight() const
+{
+    return d->contentHeight;
+}
+
+QRect ThumbnailLayout::itemRect(int item) const
+{
+    if(item < 0 || item >= d->count() || static_cast<size_t>(item) >= d->xs.size() || d->rows.empty())
+    {
+        return QRect();
+    }
+
+    const Impl::Row &row = d->rows[d->rowOf(item)];
+    const int w = d->widths[item];
+
+    if(w == Section)
+    {
+        return QRect(d->spacing, row.y, std::max(0, d->viewportWidth - 2 * d->spacing), row.height);
+    }
+
+    if(w == Unknown)
+    {
+        return QRect();
+    }
+
+    return QRect(d->xs[item], row.y, w, row.height);
+}
+
+int ThumbnailLayout::itemAt(const QPoint &pos) const
+{
+    if(d->rows.empty())
+    {
+        return -1;
+    }
+
+    const size_t r = d->rowAt(pos.y());
+    const Impl::Row &row = d->rows[r];
+
+    if(pos.y() < row.y || pos.y() >= row.y + row.height)
+    {
+        // in the spacing between rows
+        return -1;
+    }
+
+    // the last item of the row starting left of pos
+    auto begin = d->xs.begin() + row.first;
+    auto end = d->xs.begin() + std::min<size_t>(d->rowEnd(r), d->xs.size());
+    auto it = std::upper_bound(begin, end, pos.x());
+
+    if(it == begin)
+    {
+        return -1;
+    }
+
+    const int item = static_cast<int>(it - d->xs.begin()) - 1;
+    return this->itemRect(item).contains(pos) ? item : -1;
+}
+
+int ThumbnailLayout::rowCount() const
+{
+    return static_cast<int>(d->rows.size());
+}
+
+int ThumbnailLayout::rowOf(int item) const
+{
+    return d->rows.empty() ? -1 : static_cast<int>(d->rowOf(item));
+}
+
+int ThumbnailLayout::rowAt(int y) const
+{
+    return d->rows.empty() ? -1 : static_cast<int>(d->rowAt(y));
+}
+
+std::pair<int, int> ThumbnailLayout::rowItems(int row) const
+{
+    if(row < 0 || row >= this->rowCount())
+    {
+        return { -1, -1 };
+    }
+
+    return { d->rows[row].first, d->rowEnd(row) - 1 };
+}
@@ -0,0 +1,63 @@
+
+#pragma once
+
+#include <QPoint>
+#include <QRect>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/**
+ * Geometry of the items shown by ThumbnailListView. Items are flown from left to right into rows of a fixed height, wrapping at the viewport width.
+ * Section headers occupy a row of their own, spanning the entire width. The vertical positions of the rows are kept as prefix sums,
+ * so that hit-testing and finding the rows intersecting the viewport take logarithmic time.
+ * The widths of the items are cached, only those that have been inserted or invalidated are queried again by layout().
+ */
+class ThumbnailLayout
+{
+public:
+    // width to be returned for section headers
+    static constexpr int Section = -1;
+
+    ThumbnailLayout();
+    ~ThumbnailLayout();
+
+    ThumbnailLayout(const ThumbnailLayout &) = delete;
+    ThumbnailLayout &operator=(const ThumbnailLayout &) = delete;
+
+    // changing any of these flows all items again, without querying their widths
+    void setViewportWidth(int width);
+    void setRowHeight(int height);
+    void setSectionHeight(int height);
+    void setSpacing(int spacing);
+
+    // forgets all widths and sets the number of items
+    void reset(int count);
+    void insertItems(int first, int count);
+    void removeItems(int first, int count);
+    // the widths of the items first to last need to be queried again
+    void invalidate(int first, int last);
+    void invalidateAll();
+
+    bool isDirty() const;
+    // Queries the widths of inserted and invalidated items through widthOf and flows the items, starting with the row of the first one that changed.
+    void layout(const std::function<int(int)> &widthOf);
+
+    int count() const;
+    int contentHeight() const;
+
+    // The following refer to the most recent layout(). Indices are kept up to date when inserting or removing items, positions are not.
+    QRect itemRect(int item) const;
+    // the item at pos, or -1
+    int itemAt(const QPoint &pos) const;
+    int rowCount() const;
+    int rowOf(int item) const;
+    // the row at the vertical position y, clamped to the first and last row; -1 if there are no rows
+    int rowAt(int y) const;
+    // the first and last item of row
+    std::pair<int, int> rowItems(int row) const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
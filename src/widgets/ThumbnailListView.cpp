@@ -16,10 +16,20 @@
 #include <QMetaEnum>
 #include <QScrollBar>
 #include <QtGlobal>
-#include <QElapsedTimer>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QCursor>
+#include <QRubberBand>
+#include <QStyleOptionRubberBand>
+#include <QItemSelection>
+#include <QAbstractItemDelegate>
+#include <QAccessible>
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
 
 #include "AfPointOverlay.hpp"
 #include "SmartImageDecoder.hpp"
@@ -35,6 +45,7 @@
 #include "ListItemDelegate.hpp"
 #include "TraceTimer.hpp"
 #include "ProgressIndicatorHelper.hpp"
+#include "ThumbnailLayout.hpp"
 
 struct ThumbnailListView::Impl
 {
@@ -55,6 +66,88 @@ struct ThumbnailListView::Impl
 
     QPointer<ListItemDelegate> itemDelegate;
 
+    // replaces the private layout of QListView, positions are in content coordinates, i.e. without scrolling
+    ThumbnailLayout layout;
+
+    // the rubber band in content coordinates, as the one of QListView is private as well
+    QPoint pressedPosition;
+    QRect elasticBand;
+
+    QModelIndex indexOf(int row) const
+    {
+        return q->model()->index(row, 0, q->rootIndex());
+    }
+
+    QPoint offset() const
+    {
+        return QPoint(q->horizontalOffset(), q->verticalOffset());
+    }
+
+    bool isEnabled(int row) const
+    {
+        return (q->model()->flags(this->indexOf(row)) & Qt::ItemIsEnabled) != 0;
+    }
+
+    // calls f for all items intersecting rect, given in content coordinates, in the order they are laid out
+    void forEachItemIn(const QRect &rect, const std::function<void(int)> &f) const
+    {
+        if(rect.isEmpty() || this->layout.rowCount() == 0)
+        {
+            return;
+        }
+
+        for(int r = this->layout.rowAt(rect.top()), last = this->layout.rowAt(rect.bottom()); r <= last; r++)
+        {
+            auto [first, end] = this->layout.rowItems(r);
+
+            for(int i = first; i <= end; i++)
+            {
+                if(this->layout.itemRect(i).intersects(rect))
+                {
+                    f(i);
+                }
+            }
+        }
+    }
+
+    // the first and last item of the rows currently shown by the viewport
+    std::pair<int, int> visibleItems() const
+    {
+        const QRect visible = q->viewport()->rect().translated(this->offset());
+        int top = this->layout.rowAt(visible.top());
+        int bottom = this->layout.rowAt(visible.bottom());
+        return { this->layout.rowItems(top).first, this->layout.rowItems(bottom).second };
+    }
+
+    // The enabled item horizontally closest to x, searching rows starting with the given one in the direction of step. Returns -1 if there is none.
+    int closestEnabledItem(int row, int step, int x) const
+    {
+        for(; row >= 0 && row < this->layout.rowCount(); row += step)
+        {
+            auto [first, last] = this->layout.rowItems(row);
+            int best = -1;
+            int bestDistance = std::numeric_limits<int>::max();
+
+            for(int i = first; i <= last; i++)
+            {
+                int distance = std::abs(this->layout.itemRect(i).center().x() - x);
+
+                if(distance < bestDistance && this->isEnabled(i))
+                {
+                    best = i;
+                    bestDistance = distance;
+                }
+            }
+
+            if(best >= 0)
+            {
+                return best;
+            }
+        }
+
+        return -1;
+    }
+
     QString lastTargetDirectory;
     void onFileOperation(ANPV::FileOperation op)
     {
@@ -279,6 +372,8 @@ ThumbnailListView::ThumbnailListView(QWidget *parent)
     : QListView(parent), d(std::make_unique<Impl>())
 {
     this->setViewMode(QListView::IconMode);
+    // items are positioned by our own layout, don't let the user move them around
+    this->setMovement(QListView::Static);
     this->setSelectionBehavior(QAbstractItemView::SelectRows);
     this->setSelectionMode(QAbstractItemView::ExtendedSelection);
     this->setResizeMode(QListView::Adjust);
@@ -289,11 +384,22 @@ ThumbnailListView::ThumbnailListView(QWidget *parent)
     // always show scroll bars to prevent flickering, cause by an event loop that turns it on and off
     this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
     this->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    this->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
 
     d->q = this;
     d->itemDelegate = new ListItemDelegate(this);
     this->setItemDelegate(d->itemDelegate);
 
+    // the delegate derives the height of the items from the icon size
+    int iconHeight = ANPV::globalInstance()->iconHeight();
+    this->setIconSize(QSize(iconHeight, iconHeight));
+    connect(ANPV::globalInstance(), &ANPV::iconHeightChanged, this,
+            [&](int v)
+    {
+        d->layout.invalidateAll();
+        this->setIconSize(QSize(v, v));
+    });
+
     connect(ANPV::globalInstance(), &ANPV::viewFlagsChanged, this,
             [&](ViewFlags_t v, ViewFlags_t)
     {
@@ -442,6 +548,16 @@ QModelIndex ThumbnailListView::moveCursor(CursorAction cursorAction, Qt::Keyboar
         return row;
     };
 
+    auto findAvailableRowBackward = [&](int row)
+    {
+        while(row >= 0 && !(m->flags(m->index(row, 0)) & Qt::ItemIsEnabled))
+        {
+            --row;
+        }
+
+        return row;
+    };
+
     // Make sure that pressing POS1 causes selection of the first active element, so that selection and scrolling actually works
     if(cursorAction == MoveHome)
     {
@@ -455,7 +571,57 @@ QModelIndex ThumbnailListView::moveCursor(CursorAction cursorAction, Qt::Keyboar
         }
     }
 
-    return QListView::moveCursor(cursorAction, modifiers);
+    // QListView::moveCursor() relies on its private layout, so navigate through ours
+    this->executeDelayedItemsLayout();
+
+    QModelIndex current = this->currentIndex();
+
+    if(!current.isValid())
+    {
+        int row = findAvailableRowForward(0);
+        return row >= 0 ? d->indexOf(row) : QModelIndex();
+    }
+
+    const QRect rect = d->layout.itemRect(current.row());
+    int row = -1;
+
+    switch(cursorAction)
+    {
+    case MoveLeft:
+    case MovePrevious:
+        row = findAvailableRowBackward(current.row() - 1);
+        break;
+
+    case MoveRight:
+    case MoveNext:
+        row = findAvailableRowForward(current.row() + 1);
+        break;
+
+    case MoveUp:
+        row = d->closestEnabledItem(d->layout.rowOf(current.row()) - 1, -1, rect.center().x());
+        break;
+
+    case MoveDown:
+        row = d->closestEnabledItem(d->layout.rowOf(current.row()) + 1, 1, rect.center().x());
+        break;
+
+    case MovePageUp:
+        row = d->closestEnabledItem(d->layout.rowAt(rect.center().y() - this->viewport()->height()), -1, rect.center().x());
+        break;
+
+    case MovePageDown:
+        row = d->closestEnabledItem(d->layout.rowAt(rect.center().y() + this->viewport()->height()), 1, rect.center().x());
+        break;
+
+    case MoveEnd:
+        row = findAvailableRowBackward(m->rowCount() - 1);
+        break;
+
+    default:
+        break;
+    }
+
+    return row >= 0 ? d->indexOf(row) : current;
 }
 
 /* Changes the visible size of the item delegate for the section items. */
@@ -506,8 +672,33 @@ void ThumbnailListView::setSelection(const QRect &rect, QItemSelectionModel::Sel
 {
     if(state() == DragSelectingState)
     {
-        // visual selection mode (rubberband selection)
-        QListView::setSelection(rect, flags);
+        // visual selection mode (rubberband selection), merging items adjacent in the model into ranges
+        QItemSelection selection;
+        int first = -1;
+        int last = -1;
+
+        d->forEachItemIn(rect.normalized().translated(d->offset()), [&](int row)
+        {
+            if(first >= 0 && row == last + 1)
+            {
+                last = row;
+                return;
+            }
+
+            if(first >= 0)
+            {
+                selection.select(d->indexOf(first), d->indexOf(last));
+            }
+
+            first = last = row;
+        });
+
+        if(first >= 0)
+        {
+            selection.select(d->indexOf(first), d->indexOf(last));
+        }
+
+        this->selectionModel()->select(selection, flags);
     }
     else
     {
@@ -576,6 +767,15 @@ void ThumbnailListView::setModel(QAbstractItemModel *model)
     }
 
     QListView::setModel(model);
+
+    if(model)
+    {
+        // rows are about to be reordered, e.g. by sorting, so all the widths known belong to different rows afterwards
+        QObject::connect(model, &QAbstractItemModel::layoutAboutToBeChanged, this, [&]()
+        {
+            d->layout.invalidateAll();
+        });
+    }
 }
 
 QList<Image *> ThumbnailListView::checkedImages()
@@ -618,24 +818,334 @@ void ThumbnailListView::fileOperationOnSelectedFiles(QAction *action)
 
 void ThumbnailListView::rowsInserted(const QModelIndex &parent, int start, int end)
 {
-    // reimplement this to avoid flickering when inserting items, caused by clearing of QIconModeViewBase's internal "tree" object, caused by:
-    // https://github.com/qt/qtbase/blob/56aa065ab57d55cc832c45b8c260153447c57188/src/widgets/itemviews/qlistview.cpp#L714-L715
+    // QListView would clear its entire layout, causing flickering. Only flow the items starting at the inserted ones.
+    if(parent == this->rootIndex())
+    {
+        d->layout.insertItems(start, end - start + 1);
+        this->scheduleDelayedItemsLayout();
+    }
 
-    // We should call this->QListView::doItemsLayout(); here to reflect the new item in the view. Instead, this is done in the model via the updateLayout timer.
     QAbstractItemView::rowsInserted(parent, start, end);
 }
 
+void ThumbnailListView::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    if(parent == this->rootIndex())
+    {
+        d->layout.removeItems(start, end - start + 1);
+        this->scheduleDelayedItemsLayout();
+    }
+
+    QAbstractItemView::rowsAboutToBeRemoved(parent, start, end);
+}
+
+void ThumbnailListView::reset()
+{
+    QAbstractItemModel *m = this->model();
+    d->layout.reset(m ? m->rowCount(this->rootIndex()) : 0);
+    QListView::reset();
+}
+
+void ThumbnailListView::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles)
+{
+    // The model only announces the SizeHintRole for rows whose thumbnail changed in size, only their widths need to be queried again.
+    if(roles.isEmpty() || roles.contains(Qt::SizeHintRole))
+    {
+        d->layout.invalidate(topLeft.row(), bottomRight.row());
+        this->scheduleDelayedItemsLayout();
+    }
+
+    if(topLeft == bottomRight && topLeft.isValid())
+    {
+        // the base class updates the editor and accessibility, and repaints only this very item
+        QAbstractItemView::dataChanged(topLeft, bottomRight, roles);
+        return;
+    }
+
+    // For more than one row, QAbstractItemView would repaint the entire viewport. Do everything else it does, but only repaint the visible rows.
+    for(int row = topLeft.row(); row <= bottomRight.row(); row++)
+    {
+        for(int col = topLeft.column(); col <= bottomRight.column(); col++)
+        {
+            QModelIndex idx = topLeft.siblingAtRow(row).siblingAtColumn(col);
+            QWidget *editor = this->indexWidget(idx);
+
+            if(editor != nullptr)
+            {
+                this->itemDelegateForIndex(idx)->setEditorData(editor, idx);
+            }
+        }
+    }
+
+#if QT_CONFIG(accessibility)
+    if(QAccessible::isActive())
+    {
+        QAccessibleTableModelChangeEvent accessibleEvent(this, QAccessibleTableModelChangeEvent::DataChanged);
+        accessibleEvent.setFirstRow(topLeft.row());
+        accessibleEvent.setFirstColumn(topLeft.column());
+        accessibleEvent.setLastRow(bottomRight.row());
+        accessibleEvent.setLastColumn(bottomRight.column());
+        QAccessible::updateAccessibility(&accessibleEvent);
+    }
+#endif
+
+    auto [firstVisible, lastVisible] = d->visibleItems();
+    QRegion region;
+
+    for(int row = std::max(topLeft.row(), firstVisible); row <= std::min(bottomRight.row(), lastVisible); row++)
+    {
+        region += d->layout.itemRect(row).translated(-d->offset());
+    }
+
+    this->viewport()->update(region);
+}
+
 void ThumbnailListView::doItemsLayout()
 {
-    WaitCursor w;
-    QElapsedTimer e;
-    e.start();
-    this->QListView::doItemsLayout();
-    auto t = e.elapsed();
-    auto m = ANPV::globalInstance()->fileModel();
+    QAbstractItemModel *m = this->model();
+    const int rows = m ? m->rowCount(this->rootIndex()) : 0;
+
+    if(d->layout.count() != rows)
+    {
+        // we missed a change of the model, e.g. while it was being set
+        d->layout.reset(rows);
+    }
+
+    QStyleOptionViewItem option;
+    this->initViewItemOption(&option);
+
+    d->layout.setViewportWidth(this->viewport()->width());
+    d->layout.setSpacing(this->spacing());
+    d->layout.setRowHeight(d->itemDelegate->tileHeight(option));
+    d->layout.setSectionHeight(d->itemDelegate->sectionHeight());
+
+    if(d->layout.isDirty())
+    {
+        TraceTimer t(typeid(ThumbnailListView), 50);
+        d->layout.layout([&](int row)
+        {
+            QModelIndex idx = d->indexOf(row);
+
+            if(m->data(idx, SortedImageModel::ItemIsSection).toBool())
+            {
+                return ThumbnailLayout::Section;
+            }
+
+            return this->itemDelegateForIndex(idx)->sizeHint(option, idx).width();
+        });
+    }
+
+    // bypass the layout of QListView, this only updates the scroll bars and the viewport
+    this->QAbstractItemView::doItemsLayout();
+}
+
+void ThumbnailListView::updateGeometries()
+{
+    const int viewportHeight = this->viewport()->height();
+    auto *vsb = this->verticalScrollBar();
+    vsb->setSingleStep(std::max(1, this->iconSize().height() / 4));
+    vsb->setPageStep(viewportHeight);
+    vsb->setRange(0, std::max(0, d->layout.contentHeight() - viewportHeight));
+    this->horizontalScrollBar()->setRange(0, 0);
+
+    // bypass QListView, which would apply the size of its own layout
+    this->QAbstractItemView::updateGeometries();
+}
+
+QRect ThumbnailListView::visualRect(const QModelIndex &index) const
+{
+    if(!index.isValid() || index.column() != 0 || index.parent() != this->rootIndex())
+    {
+        return QRect();
+    }
+
+    return d->layout.itemRect(index.row()).translated(-d->offset());
+}
+
+QModelIndex ThumbnailListView::indexAt(const QPoint &p) const
+{
+    int row = d->layout.itemAt(p + d->offset());
+    return row >= 0 ? d->indexOf(row) : QModelIndex();
+}
+
+void ThumbnailListView::scrollTo(const QModelIndex &index, ScrollHint hint)
+{
+    const QRect rect = this->visualRect(index);
+    const QRect area = this->viewport()->rect();
+
+    if(!rect.isValid())
+    {
+        return;
+    }
+
+    auto *vsb = this->verticalScrollBar();
+    int y = vsb->value();
+
+    switch(hint)
+    {
+    case EnsureVisible:
+        if(rect.top() < area.top() || rect.height() > area.height())
+        {
+            y += rect.top() - area.top();
+        }
+        else if(rect.bottom() > area.bottom())
+        {
+            y += rect.bottom() - area.bottom();
+        }
+
+        break;
+
+    case PositionAtTop:
+        y += rect.top() - area.top();
+        break;
+
+    case PositionAtBottom:
+        y += rect.bottom() - area.bottom();
+        break;
+
+    case PositionAtCenter:
+        y += rect.center().y() - area.center().y();
+        break;
+    }
+
+    vsb->setValue(y);
+}
+
+int ThumbnailListView::horizontalOffset() const
+{
+    return this->horizontalScrollBar()->value();
+}
+
+int ThumbnailListView::verticalOffset() const
+{
+    return this->verticalScrollBar()->value();
+}
+
+void ThumbnailListView::scrollContentsBy(int dx, int dy)
+{
+    // QListView would scroll by its own layout
+    this->QAbstractItemView::scrollContentsBy(dx, dy);
+}
+
+QRegion ThumbnailListView::visualRegionForSelection(const QItemSelection &selection) const
+{
+    auto [firstVisible, lastVisible] = d->visibleItems();
+    QRegion region;
+
+    for(const QItemSelectionRange &range : selection)
+    {
+        if(range.parent() != this->rootIndex())
+        {
+            continue;
+        }
+
+        for(int row = std::max(range.top(), firstVisible); row <= std::min(range.bottom(), lastVisible); row++)
+        {
+            region += d->layout.itemRect(row).translated(-d->offset());
+        }
+    }
+
+    return region;
+}
+
+void ThumbnailListView::paintEvent(QPaintEvent *event)
+{
+    if(d->layout.isDirty())
+    {
+        // rows have been inserted or removed, don't paint them at outdated positions
+        this->executeDelayedItemsLayout();
+    }
+
+    QAbstractItemModel *m = this->model();
+    QItemSelectionModel *selection = this->selectionModel();
+
+    if(m == nullptr)
+    {
+        return;
+    }
+
+    QStyleOptionViewItem option;
+    this->initViewItemOption(&option);
+    const QStyle::State state = option.state;
+    const bool enabled = (state & QStyle::State_Enabled) != 0;
+
+    const QModelIndex current = this->currentIndex();
+    const bool focus = (this->hasFocus() || this->viewport()->hasFocus()) && current.isValid();
+    const QModelIndex hover = this->viewport()->underMouse() ? this->indexAt(this->viewport()->mapFromGlobal(QCursor::pos())) : QModelIndex();
+
+    QPainter painter(this->viewport());
+
+    // only the items of the rows intersecting the exposed area are visited
+    d->forEachItemIn(event->rect().translated(d->offset()), [&](int row)
+    {
+        const QModelIndex idx = d->indexOf(row);
+        option.rect = d->layout.itemRect(row).translated(-d->offset());
+        option.state = state;
+
+        if(selection != nullptr && selection->isSelected(idx))
+        {
+            option.state |= QStyle::State_Selected;
+        }
+
+        if(enabled)
+        {
+            if(m->flags(idx) & Qt::ItemIsEnabled)
+            {
+                option.palette.setCurrentColorGroup(QPalette::Normal);
+            }
+            else
+            {
+                option.state &= ~QStyle::State_Enabled;
+                option.palette.setCurrentColorGroup(QPalette::Disabled);
+            }
+        }
+
+        option.state.setFlag(QStyle::State_HasFocus, focus && idx == current);
+        option.state.setFlag(QStyle::State_MouseOver, idx == hover);
+
+        this->itemDelegateForIndex(idx)->paint(&painter, option, idx);
+    });
+
+    if(d->elasticBand.isValid())
+    {
+        QStyleOptionRubberBand opt;
+        opt.initFrom(this);
+        opt.shape = QRubberBand::Rectangle;
+        opt.opaque = false;
+        opt.rect = d->elasticBand.translated(-d->offset()).intersected(this->viewport()->rect().adjusted(-16, -16, 16, 16));
+        painter.save();
+        this->style()->drawControl(QStyle::CE_RubberBand, &opt, &painter);
+        painter.restore();
+    }
+}
+
+void ThumbnailListView::mousePressEvent(QMouseEvent *event)
+{
+    d->pressedPosition = event->position().toPoint() + d->offset();
+    QListView::mousePressEvent(event);
+}
+
+void ThumbnailListView::mouseMoveEvent(QMouseEvent *event)
+{
+    QListView::mouseMoveEvent(event);
+
+    if(this->state() == DragSelectingState)
+    {
+        QRect band = QRect(d->pressedPosition, event->position().toPoint() + d->offset()).normalized();
+        const int margin = 2 * this->style()->pixelMetric(QStyle::PM_DefaultFrameWidth);
+        this->viewport()->update(band.united(d->elasticBand).adjusted(-margin, -margin, margin, margin).translated(-d->offset()));
+        d->elasticBand = band;
+    }
+}
+
+void ThumbnailListView::mouseReleaseEvent(QMouseEvent *event)
+{
+    QListView::mouseReleaseEvent(event);
 
-    if(m != nullptr)
+    if(d->elasticBand.isValid())
     {
-        m->setLayoutTimerInterval(t * 3);
+        const int margin = 2 * this->style()->pixelMetric(QStyle::PM_DefaultFrameWidth);
+        this->viewport()->update(d->elasticBand.adjusted(-margin, -margin, margin, margin).translated(-d->offset()));
+        d->elasticBand = QRect();
     }
 }
@@ -12,6 +12,8 @@
 
 class QAbstractItemModel;
 class QWheelEvent;
+class QPaintEvent;
+class QMouseEvent;
 class QWidget;
 class QAction;
 class SortedImageModel;
@@ -27,6 +29,12 @@ public:
     ThumbnailListView(QWidget *parent = nullptr);
     ~ThumbnailListView() override;
     void setModel(QAbstractItemModel *model) override;
+    void reset() override;
+
+    // the geometry of the items is given by our own ThumbnailLayout, rather than by the private one of QListView
+    QRect visualRect(const QModelIndex &index) const override;
+    QModelIndex indexAt(const QPoint &p) const override;
+    void scrollTo(const QModelIndex &index, ScrollHint hint = EnsureVisible) override;
 
     void fileOperationOnSelectedFiles(QAction *);
     QList<Image *> checkedImages();
@@ -39,7 +47,19 @@ protected:
     QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) override;
     void setSelection(const QRect &rect, QItemSelectionModel::SelectionFlags flags) override;
     void rowsInserted(const QModelIndex &parent, int start, int end) override;
+    void rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end) override;
+    void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles = QList<int>()) override;
     void doItemsLayout() override;
+    void updateGeometries() override;
+    int horizontalOffset() const override;
+    int verticalOffset() const override;
+    void scrollContentsBy(int dx, int dy) override;
+    QRegion visualRegionForSelection(const QItemSelection &selection) const override;
+
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
 
 private:
     struct Impl;
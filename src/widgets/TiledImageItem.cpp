@@ -0,0 +1,51 @@
+
+#include "TiledImageItem.hpp"
+#include "TileCache.hpp"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+struct TiledImageItem::Impl
+{
+    TileCache *cache = nullptr;
+};
+
+TiledImageItem::TiledImageItem() : d(std::make_unique<Impl>())
+{
+    // needed for a valid exposedRect in paint()
+    this->setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+TiledImageItem::~TiledImageItem() = default;
+
+TileCache *TiledImageItem::tileCache() const
+{
+    return d->cache;
+}
+
+void TiledImageItem::setTileCache(TileCache *cache)
+{
+    this->prepareGeometryChange();
+    d->cache = cache;
+    this->update();
+}
+
+QRectF TiledImageItem::boundingRect() const
+{
+    return d->cache == nullptr ? QRectF() : QRectF(d->cache->fullResolutionRect());
+}
+
+void TiledImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *)
+{
+    if(d->cache == nullptr)
+    {
+        return;
+    }
+
+    // device pixels per full resolution pixel
+    qreal scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    int level = TileCache::levelForScale(scale);
+
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    d->cache->paint(*painter, option->exposedRect.toAlignedRect(), level);
+}
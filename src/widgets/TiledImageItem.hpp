@@ -0,0 +1,30 @@
+
+#pragma once
+
+#include <QGraphicsItem>
+#include <memory>
+
+class TileCache;
+
+/**
+ * Paints the tiles of a TileCache covering the exposed area, picking the pyramid level that matches the current zoom.
+ * The item is placed in full resolution coordinates, i.e. at the origin of the scene. Nothing is ever composed into an intermediate image,
+ * so that panning across huge images only costs drawing the few visible tiles.
+ */
+class TiledImageItem : public QGraphicsItem
+{
+public:
+    TiledImageItem();
+    ~TiledImageItem() override;
+
+    // the cache is not owned and must outlive the item, or be reset before being destroyed
+    TileCache *tileCache() const;
+    void setTileCache(TileCache *cache);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> d;
+};
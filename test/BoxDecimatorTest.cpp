@@ -0,0 +1,85 @@
+
+#include "BoxDecimatorTest.hpp"
+#include "BoxDecimator.hpp"
+
+#include <QTest>
+#include <vector>
+
+QTEST_MAIN(BoxDecimatorTest)
+#include "BoxDecimatorTest.moc"
+
+static std::vector<uint32_t> makeSource(int width, int height)
+{
+    std::vector<uint32_t> src(static_cast<size_t>(width) * height);
+
+    for(size_t i = 0; i < src.size(); i++)
+    {
+        src[i] = 0xFF000000u | static_cast<uint32_t>(i * 10);
+    }
+
+    return src;
+}
+
+void BoxDecimatorTest::testDecimatedSize()
+{
+    QCOMPARE(BoxDecimator::decimatedSize(QSize(4, 4), 2), QSize(2, 2));
+    QCOMPARE(BoxDecimator::decimatedSize(QSize(5, 3), 2), QSize(3, 2));
+    QCOMPARE(BoxDecimator::decimatedSize(QSize(5, 3), 1), QSize(5, 3));
+}
+
+void BoxDecimatorTest::testAverage()
+{
+    const int w = 5, h = 3;
+    std::vector<uint32_t> src = makeSource(w, h);
+    std::vector<uint32_t> dst(6, 0);
+    BoxDecimator dec(w, h, 2, dst.data(), 3);
+
+    dec.addPixels(0, 0, &src[0], w);
+    // the first row of blocks is incomplete
+    QVERIFY(dec.flush(1).isEmpty());
+
+    dec.addPixels(0, 1, &src[w], w);
+    QCOMPARE(dec.flush(2), QRect(0, 0, 3, 1));
+
+    dec.addPixels(0, 2, &src[2 * w], w);
+    QCOMPARE(dec.flush(3), QRect(0, 1, 3, 1));
+
+    // (0 + 10 + 50 + 60) / 4
+    QCOMPARE(dst[0] & 0xFF, 30u);
+    // incomplete block at the right edge: (40 + 90) / 2
+    QCOMPARE(dst[2] & 0xFF, 65u);
+    // incomplete block at the bottom edge: (100 + 110) / 2
+    QCOMPARE(dst[3] & 0xFF, 105u);
+    QCOMPARE(dst[5] >> 24, 0xFFu);
+}
+
+void BoxDecimatorTest::testTilewise()
+{
+    const int w = 8, h = 4;
+    std::vector<uint32_t> src = makeSource(w, h);
+    std::vector<uint32_t> rowwise(4, 0), tilewise(4, 0);
+
+    BoxDecimator byRow(w, h, 4, rowwise.data(), 2);
+
+    for(int y = 0; y < h; y++)
+    {
+        byRow.addPixels(0, y, &src[y * w], w);
+    }
+
+    byRow.flush(h);
+
+    // feed the right tile before the left one
+    BoxDecimator byTile(w, h, 4, tilewise.data(), 2);
+
+    for(int x : { 4, 0 })
+    {
+        for(int y = 0; y < h; y++)
+        {
+            byTile.addPixels(x, y, &src[y * w + x], 4);
+        }
+    }
+
+    byTile.flush(h);
+
+    QCOMPARE(tilewise, rowwise);
+}
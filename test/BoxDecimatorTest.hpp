@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include <QObject>
+
+class BoxDecimatorTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testDecimatedSize();
+    void testAverage();
+    void testTilewise();
+};
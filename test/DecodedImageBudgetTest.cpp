@@ -0,0 +1,111 @@
+
+#include "DecodedImageBudgetTest.hpp"
+#include "DecodedImageBudget.hpp"
+
+#include <QTest>
+#include <QSignalSpy>
+#include <QCoreApplication>
+
+QTEST_MAIN(DecodedImageBudgetTest)
+#include "DecodedImageBudgetTest.moc"
+
+// the budget never dereferences the images, any distinct address will do
+static const Image *fakeImage(int i)
+{
+    static char storage[8];
+    return reinterpret_cast<const Image *>(&storage[i]);
+}
+
+void DecodedImageBudgetTest::testAccounting()
+{
+    auto *budget = DecodedImageBudget::globalInstance();
+    budget->setLimit(1000);
+
+    budget->update(fakeImage(0), 100);
+    budget->update(fakeImage(1), 200);
+    QCOMPARE(budget->usage(), 300);
+
+    budget->update(fakeImage(0), 50);
+    QCOMPARE(budget->usage(), 250);
+
+    budget->update(fakeImage(0), 0);
+    budget->update(fakeImage(1), 0);
+    QCOMPARE(budget->usage(), 0);
+}
+
+void DecodedImageBudgetTest::testEvictionOrder()
+{
+    auto *budget = DecodedImageBudget::globalInstance();
+    budget->setLimit(1000);
+    QSignalSpy spy(budget, &DecodedImageBudget::evictionRequested);
+
+    budget->update(fakeImage(0), 400);
+    budget->update(fakeImage(1), 400);
+    budget->update(fakeImage(2), 100);
+    budget->touch(fakeImage(0));
+
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 0);
+
+    // image 1 is the least recently used one now
+    budget->update(fakeImage(3), 300);
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).value<const Image *>(), fakeImage(1));
+
+    // Still too large. The eviction of image 1 has been requested already, but it might not be released, so move on to the next ones.
+    budget->update(fakeImage(4), 10);
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 3);
+    QCOMPARE(spy.at(1).at(0).value<const Image *>(), fakeImage(2));
+    QCOMPARE(spy.at(2).at(0).value<const Image *>(), fakeImage(0));
+
+    for(int i = 0; i < 5; i++)
+    {
+        budget->update(fakeImage(i), 0);
+    }
+
+    QCOMPARE(budget->usage(), 0);
+}
+
+void DecodedImageBudgetTest::testDecline()
+{
+    auto *budget = DecodedImageBudget::globalInstance();
+    budget->setLimit(1000);
+    QSignalSpy spy(budget, &DecodedImageBudget::evictionRequested);
+
+    budget->update(fakeImage(0), 600);
+    budget->update(fakeImage(1), 600);
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).value<const Image *>(), fakeImage(0));
+
+    // image 0 hasn't been released yet, so move on to image 1
+    budget->enforceLimit();
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.at(1).at(0).value<const Image *>(), fakeImage(1));
+
+    // neither is asked again, as long as their owners don't decline
+    budget->enforceLimit();
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 2);
+
+    // e.g. because it was displayed, and hidden afterwards
+    budget->decline(fakeImage(0));
+    budget->enforceLimit();
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 3);
+    QCOMPARE(spy.at(2).at(0).value<const Image *>(), fakeImage(0));
+
+    // displaying an image again resets the request as well
+    budget->touch(fakeImage(0));
+    budget->enforceLimit();
+    QCoreApplication::processEvents();
+    QCOMPARE(spy.count(), 4);
+    QCOMPARE(spy.at(3).at(0).value<const Image *>(), fakeImage(0));
+
+    budget->update(fakeImage(0), 0);
+    budget->update(fakeImage(1), 0);
+    QCOMPARE(budget->usage(), 0);
+}
@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include <QObject>
+
+class DecodedImageBudgetTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testAccounting();
+    void testEvictionOrder();
+    void testDecline();
+};
@@ -102,6 +102,27 @@ void DecoderTest::errorWhileOpeningFile()
     dec.close();
 }
 
+void DecoderTest::testSniffFormat()
+{
+    auto sniff = [](const QByteArray &content)
+    {
+        QTemporaryFile f("anpvtestfile-XXXXXX");
+        f.open();
+        f.write(content);
+        f.close();
+        return DecoderFactory::globalInstance()->sniffFormat(QFileInfo(f.fileName()));
+    };
+
+    QCOMPARE(sniff(QByteArray("\xFF\xD8\xFF\xE0", 4)), QByteArray("jpeg"));
+    QCOMPARE(sniff(QByteArray("\x89PNG\r\n\x1A\n\0\0", 10)), QByteArray("png"));
+    QCOMPARE(sniff(QByteArray("MM\0*\0\0\0\x08", 8)), QByteArray("tiff"));
+    // not to be mistaken for a TIFF, but RAWs require an extension
+    QCOMPARE(sniff(QByteArray("II*\0\x10\0\0\0CR\x02\0", 12)), QByteArray());
+    QCOMPARE(sniff(QByteArray("\0\0\0\x0CJXL \r\n\x87\n", 12)), QByteArray("jxl"));
+    QCOMPARE(sniff(QByteArray("<?xpacket begin=")), QByteArray());
+    QCOMPARE(sniff(QByteArray()), QByteArray());
+}
+
 void DecoderTest::testInitialize()
 {
     QTemporaryFile jpg("anpvtestfile-XXXXXX.jpg");
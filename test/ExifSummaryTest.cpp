@@ -0,0 +1,201 @@
+
+#include "ExifSummaryTest.hpp"
+#include "ExifSummary.hpp"
+
+#include <QByteArray>
+#include <QTest>
+#include <QtEndian>
+#include <vector>
+
+QTEST_MAIN(ExifSummaryTest)
+#include "ExifSummaryTest.moc"
+
+namespace
+{
+// Assembles a TIFF structure consisting of IFD0 and an optional EXIF IFD, values larger than four bytes are stored behind both IFDs.
+struct TiffBuilder
+{
+    struct Entry
+    {
+        quint16 tag;
+        quint16 type;
+        quint32 count;
+        QByteArray value;
+    };
+
+    bool bigEndian;
+    std::vector<Entry> ifd0;
+    std::vector<Entry> exif;
+
+    QByteArray u16(quint16 v) const
+    {
+        QByteArray b(2, '\0');
+        this->bigEndian ? qToBigEndian(v, b.data()) : qToLittleEndian(v, b.data());
+        return b;
+    }
+
+    QByteArray u32(quint32 v) const
+    {
+        QByteArray b(4, '\0');
+        this->bigEndian ? qToBigEndian(v, b.data()) : qToLittleEndian(v, b.data());
+        return b;
+    }
+
+    Entry ascii(quint16 tag, const QByteArray &str) const
+    {
+        return Entry{ tag, 2, static_cast<quint32>(str.size() + 1), str + '\0' };
+    }
+
+    Entry shortValue(quint16 tag, quint16 v) const
+    {
+        return Entry{ tag, 3, 1, this->u16(v) };
+    }
+
+    Entry rational(quint16 tag, quint32 num, quint32 den) const
+    {
+        return Entry{ tag, 5, 1, this->u32(num) + this->u32(den) };
+    }
+
+    QByteArray build() const
+    {
+        std::vector<Entry> first = this->ifd0;
+        const qint64 exifOff = 8 + 2 + 12 * (static_cast<qint64>(first.size()) + (this->exif.empty() ? 0 : 1)) + 4;
+
+        if(!this->exif.empty())
+        {
+            // the EXIF IFD follows IFD0
+            first.push_back(Entry{ 0x8769, 4, 1, this->u32(exifOff) });
+        }
+
+        const qint64 dataOff = exifOff + (this->exif.empty() ? 0 : 2 + 12 * static_cast<qint64>(this->exif.size()) + 4);
+        QByteArray data;
+
+        auto writeIfd = [&](const std::vector<Entry> &entries)
+        {
+            QByteArray ifd = this->u16(static_cast<quint16>(entries.size()));
+
+            for(const Entry &e : entries)
+            {
+                ifd += this->u16(e.tag) + this->u16(e.type) + this->u32(e.count);
+
+                if(e.value.size() <= 4)
+                {
+                    ifd += e.value + QByteArray(4 - e.value.size(), '\0');
+                }
+                else
+                {
+                    ifd += this->u32(static_cast<quint32>(dataOff + data.size()));
+                    data += e.value;
+                }
+            }
+
+            return ifd + this->u32(0);
+        };
+
+        QByteArray tiff = QByteArray(this->bigEndian ? "MM" : "II") + this->u16(42) + this->u32(8);
+        tiff += writeIfd(first);
+
+        if(!this->exif.empty())
+        {
+            tiff += writeIfd(this->exif);
+        }
+
+        return tiff + data;
+    }
+};
+
+bool decode(ExifSummary &summary, const QByteArray &tiff)
+{
+    return summary.decode(reinterpret_cast<const unsigned char *>(tiff.constData()), tiff.size());
+}
+}
+
+void ExifSummaryTest::testDecode_data()
+{
+    QTest::addColumn<bool>("bigEndian");
+
+    QTest::newRow("little endian") << false;
+    QTest::newRow("big endian") << true;
+}
+
+void ExifSummaryTest::testDecode()
+{
+    QFETCH(bool, bigEndian);
+
+    TiffBuilder b{ bigEndian, {}, {} };
+    b.ifd0.push_back(b.ascii(0x0110, "Canon EOS 5D"));
+    b.ifd0.push_back(b.ascii(0x0132, "2020:01:02 03:04:05"));
+    b.exif.push_back(b.rational(0x829A, 1, 250));
+    b.exif.push_back(b.rational(0x829D, 28, 10));
+    b.exif.push_back(b.shortValue(0x8827, 400));
+    b.exif.push_back(b.ascii(0x9003, "2021:06:07 08:09:10"));
+    b.exif.push_back(b.rational(0x920A, 50, 1));
+    // short enough to be stored inline
+    b.exif.push_back(b.ascii(0xA434, "EF"));
+
+    ExifSummary s;
+    QVERIFY(decode(s, b.build()));
+
+    // DateTimeOriginal takes precedence over DateTime of IFD0
+    QCOMPARE(s.dateRecorded, QDateTime(QDate(2021, 6, 7), QTime(8, 9, 10)));
+    QVERIFY(s.hasExposureTime());
+    QCOMPARE(s.exposureNum, 1u);
+    QCOMPARE(s.exposureDen, 250u);
+    QCOMPARE(s.exposureTime, 1.0 / 250);
+    QCOMPARE(s.aperture, 2.8);
+    QCOMPARE(s.iso, int64_t(400));
+    QCOMPARE(s.focalLength, 50.0);
+    QCOMPARE(s.lens, QStringLiteral("EF"));
+    QCOMPARE(s.cameraModel, QStringLiteral("Canon EOS 5D"));
+}
+
+void ExifSummaryTest::testDateFallback()
+{
+    TiffBuilder b{ false, {}, {} };
+    b.ifd0.push_back(b.ascii(0x0132, "2020:01:02 03:04:05"));
+    b.exif.push_back(b.rational(0x829D, 4, 1));
+
+    ExifSummary s;
+    QVERIFY(decode(s, b.build()));
+    QCOMPARE(s.dateRecorded, QDateTime(QDate(2020, 1, 2), QTime(3, 4, 5)));
+    QCOMPARE(s.aperture, 4.0);
+}
+
+void ExifSummaryTest::testMissingDate()
+{
+    TiffBuilder b{ true, {}, {} };
+    b.exif.push_back(b.shortValue(0x8827, 100));
+    // zero denominator
+    b.exif.push_back(b.rational(0x829D, 4, 0));
+
+    ExifSummary s;
+    // a valid structure, the caller has to look for the date elsewhere
+    QVERIFY(decode(s, b.build()));
+    QVERIFY(!s.dateRecorded.isValid());
+    QCOMPARE(s.iso, int64_t(100));
+    QVERIFY(!s.hasAperture());
+    QVERIFY(!s.hasExposureTime());
+    QVERIFY(!s.hasFocalLength());
+    QVERIFY(s.lens.isEmpty());
+    QVERIFY(s.cameraModel.isEmpty());
+}
+
+void ExifSummaryTest::testInvalid()
+{
+    ExifSummary s;
+    QVERIFY(!decode(s, QByteArray()));
+    QVERIFY(!decode(s, QByteArray("II*")));
+    QVERIFY(!decode(s, QByteArray("XX\x2a\0\x08\0\0\0", 8)));
+    QVERIFY(!decode(s, QByteArray("II\x2b\0\x08\0\0\0", 8)));
+
+    // IFD0 and the value of DateTimeOriginal point outside the buffer
+    QVERIFY(decode(s, QByteArray("II\x2a\0\xff\0\0\0", 8)));
+    QVERIFY(!s.dateRecorded.isValid());
+
+    TiffBuilder b{ false, {}, {} };
+    b.exif.push_back(b.ascii(0x9003, "2021:06:07 08:09:10"));
+    QByteArray tiff = b.build();
+    tiff.chop(10);
+    QVERIFY(decode(s, tiff));
+    QVERIFY(!s.dateRecorded.isValid());
+}
@@ -0,0 +1,15 @@
+
+#pragma once
+
+#include <QObject>
+
+class ExifSummaryTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testDecode_data();
+    void testDecode();
+    void testDateFallback();
+    void testMissingDate();
+    void testInvalid();
+};
@@ -0,0 +1,170 @@
+
+#include "MetadataLocatorTest.hpp"
+#include "MetadataLocator.hpp"
+
+#include <QTest>
+#include <QByteArray>
+#include <QtEndian>
+
+QTEST_MAIN(MetadataLocatorTest)
+#include "MetadataLocatorTest.moc"
+
+// a little endian TIFF header followed by an empty IFD0
+static const QByteArray tiff("II\x2A\x00\x08\x00\x00\x00\x00\x00\x00\x00\x00\x00", 14);
+
+static QByteArray be16(quint16 v)
+{
+    QByteArray b(2, 0);
+    qToBigEndian(v, b.data());
+    return b;
+}
+
+static QByteArray be32(quint32 v)
+{
+    QByteArray b(4, 0);
+    qToBigEndian(v, b.data());
+    return b;
+}
+
+static QByteArray jpegSegment(char marker, const QByteArray &payload)
+{
+    return QByteArray("\xFF") + marker + be16(payload.size() + 2) + payload;
+}
+
+static QByteArray pngChunk(const char *type, const QByteArray &payload)
+{
+    // CRC is not checked by the locator
+    return be32(payload.size()) + type + payload + be32(0);
+}
+
+static QByteArray jxlBox(const char *type, const QByteArray &payload)
+{
+    return be32(payload.size() + 8) + type + payload;
+}
+
+static bool locate(const QByteArray &file, MetadataSegments &seg)
+{
+    return MetadataLocator::locate(reinterpret_cast<const unsigned char *>(file.constData()), file.size(), seg);
+}
+
+void MetadataLocatorTest::testJpeg()
+{
+    QByteArray file("\xFF\xD8");
+    file += jpegSegment('\xE1', QByteArray("Exif\0\0", 6) + tiff);
+    file += jpegSegment('\xE1', QByteArray("http://ns.adobe.com/xap/1.0/\0", 29) + "<x:xmpmeta/>");
+    file += jpegSegment('\xFE', "a comment");
+    file += jpegSegment('\xDA', QByteArray(10, 0));
+    // fake entropy coded data, which must not be looked at
+    file += QByteArray(100, '\xFF');
+
+    MetadataSegments seg;
+    QVERIFY(locate(file, seg));
+    QCOMPARE(seg.exif, tiff);
+    QCOMPARE(seg.xmp, QByteArray("<x:xmpmeta/>"));
+    QCOMPARE(seg.comment, QByteArray("a comment"));
+
+    // truncated segment
+    QVERIFY(!locate(file.left(10), seg));
+}
+
+static QByteArray photoshopResource(quint16 id, const QByteArray &name, const QByteArray &data)
+{
+    QByteArray res = QByteArray("8BIM") + be16(id) + char(name.size()) + name;
+
+    if(res.size() % 2)
+    {
+        res += '\0';
+    }
+
+    res += be32(data.size()) + data;
+    return (data.size() % 2) ? res + '\0' : res;
+}
+
+void MetadataLocatorTest::testJpegIptc()
+{
+    // a caption record, i.e. IPTC-IIM dataset 2:120
+    const QByteArray iptc = QByteArray("\x1C\x02\x78", 3) + be16(7) + "caption";
+    const QByteArray photoshop = QByteArray("Photoshop 3.0\0", 14)
+                                 + photoshopResource(0x03ED, "odd", "12345")
+                                 + photoshopResource(0x0404, QByteArray(), iptc);
+
+    QByteArray file("\xFF\xD8");
+    file += jpegSegment('\xED', photoshop);
+    file += jpegSegment('\xDA', QByteArray(10, 0));
+
+    MetadataSegments seg;
+    QVERIFY(locate(file, seg));
+    QCOMPARE(seg.iptc, iptc);
+    QVERIFY(seg.exif.isEmpty());
+
+    // resources without IPTC
+    file = QByteArray("\xFF\xD8") + jpegSegment('\xED', QByteArray("Photoshop 3.0\0", 14) + photoshopResource(0x03ED, "", "1234"));
+    QVERIFY(locate(file, seg));
+    QVERIFY(seg.iptc.isEmpty());
+
+    // resources split across multiple segments are left to Exiv2
+    file = QByteArray("\xFF\xD8") + jpegSegment('\xED', photoshop) + jpegSegment('\xED', photoshop);
+    QVERIFY(!locate(file, seg));
+
+    // the size of the IPTC resource exceeds the segment
+    QByteArray truncated = photoshop;
+    truncated.chop(4);
+    file = QByteArray("\xFF\xD8") + jpegSegment('\xED', truncated);
+    QVERIFY(!locate(file, seg));
+}
+
+void MetadataLocatorTest::testTiff()
+{
+    QByteArray file = tiff + QByteArray(100, 0);
+
+    MetadataSegments seg;
+    QVERIFY(locate(file, seg));
+    QCOMPARE(seg.exif, file);
+    QVERIFY(seg.xmp.isEmpty());
+}
+
+void MetadataLocatorTest::testPng()
+{
+    QByteArray file("\x89PNG\r\n\x1A\n");
+    file += pngChunk("IHDR", QByteArray(13, 0));
+    file += pngChunk("iTXt", QByteArray("XML:com.adobe.xmp\0\0\0en\0\0", 24) + "<x:xmpmeta/>");
+    file += pngChunk("IDAT", QByteArray(50, 'x'));
+    file += pngChunk("eXIf", tiff);
+    file += pngChunk("IEND", QByteArray());
+
+    MetadataSegments seg;
+    QVERIFY(locate(file, seg));
+    QCOMPARE(seg.exif, tiff);
+    QCOMPARE(seg.xmp, QByteArray("<x:xmpmeta/>"));
+
+    // hex encoded legacy profiles are left to Exiv2
+    file.insert(33, pngChunk("zTXt", QByteArray("Raw profile type exif\0\0", 23)));
+    QVERIFY(!locate(file, seg));
+}
+
+void MetadataLocatorTest::testJxl()
+{
+    QByteArray file("\x00\x00\x00\x0CJXL \r\n\x87\n", 12);
+    file += jxlBox("ftyp", QByteArray("jxl \0\0\0\0jxl ", 12));
+    file += jxlBox("Exif", be32(2) + "ab" + tiff);
+    file += jxlBox("xml ", "<x:xmpmeta/>");
+    file += jxlBox("jxlc", QByteArray("\xFF\x0A", 2) + QByteArray(50, 'x'));
+
+    MetadataSegments seg;
+    QVERIFY(locate(file, seg));
+    QCOMPARE(seg.exif, tiff);
+    QCOMPARE(seg.xmp, QByteArray("<x:xmpmeta/>"));
+
+    file += jxlBox("brob", QByteArray("Exif", 4) + QByteArray(10, 0));
+    QVERIFY(!locate(file, seg));
+}
+
+void MetadataLocatorTest::testUnknown()
+{
+    // an ISO BMFF based file, e.g. CR3 or HEIF
+    QByteArray file = be32(24) + "ftypcrx " + QByteArray(30, 0);
+
+    MetadataSegments seg;
+    QVERIFY(!locate(file, seg));
+    QVERIFY(seg.exif.isEmpty());
+}
@@ -0,0 +1,16 @@
+
+#pragma once
+
+#include <QObject>
+
+class MetadataLocatorTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testJpeg();
+    void testJpegIptc();
+    void testTiff();
+    void testPng();
+    void testJxl();
+    void testUnknown();
+};
@@ -0,0 +1,169 @@
+
+#include "PyramidSidecarTest.hpp"
+#include "PyramidSidecar.hpp"
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDateTime>
+#include <vector>
+
+QTEST_MAIN(PyramidSidecarTest)
+#include "PyramidSidecarTest.moc"
+
+// red on the left half, blue on the right half, so that the border stays sharp on all levels
+static QImage makeSource()
+{
+    QImage img(1200, 700, QImage::Format_ARGB32);
+    img.fill(Qt::blue);
+
+    for(int y = 0; y < img.height(); y++)
+    {
+        for(int x = 0; x < img.width() / 2; x++)
+        {
+            img.setPixel(x, y, qRgb(255, 0, 0));
+        }
+    }
+
+    return img;
+}
+
+static QColor rgbaAt(const std::vector<uchar> &buf, int stride, int x, int y)
+{
+    const uchar *p = &buf[static_cast<size_t>(y) * stride + static_cast<size_t>(x) * 4];
+    return QColor(p[0], p[1], p[2], p[3]);
+}
+
+void PyramidSidecarTest::testRoundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("sub/pyramid.tif"));
+
+    QVERIFY(PyramidSidecar::generate(makeSource(), path));
+    QVERIFY(QFile::exists(path));
+    QVERIFY(!QFile::exists(path + QStringLiteral(".part")));
+
+    PyramidSidecar sidecar(path);
+    QVERIFY(sidecar.isValid());
+
+    // halved until a level fits into a single tile
+    QCOMPARE(sidecar.levels(), 3);
+    QCOMPARE(sidecar.levelSize(1), QSize(600, 350));
+    QCOMPARE(sidecar.levelSize(2), QSize(300, 175));
+    QCOMPARE(sidecar.levelSize(3), QSize(150, 88));
+    QCOMPARE(sidecar.levelSize(0), QSize());
+    QCOMPARE(sidecar.levelSize(4), QSize());
+
+    for(int level = 1; level <= sidecar.levels(); level++)
+    {
+        const QSize size = sidecar.levelSize(level);
+        const int stride = size.width() * 4;
+        std::vector<uchar> buf(static_cast<size_t>(stride) * size.height());
+        QVERIFY(sidecar.read(level, QRect(QPoint(0, 0), size), buf.data(), stride));
+
+        const int border = size.width() / 2;
+        QCOMPARE(rgbaAt(buf, stride, 0, 0), QColor(255, 0, 0));
+        QCOMPARE(rgbaAt(buf, stride, border - 1, size.height() - 1), QColor(255, 0, 0));
+        QCOMPARE(rgbaAt(buf, stride, border, 0), QColor(0, 0, 255));
+        QCOMPARE(rgbaAt(buf, stride, size.width() - 1, size.height() - 1), QColor(0, 0, 255));
+    }
+}
+
+void PyramidSidecarTest::testReadAcrossTiles()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("pyramid.tif"));
+    QVERIFY(PyramidSidecar::generate(makeSource(), path));
+
+    PyramidSidecar sidecar(path);
+    QVERIFY(sidecar.isValid());
+
+    // spans two tiles in each direction on level 1
+    const QRect rect(250, 200, 100, 100);
+    const int stride = rect.width() * 4;
+    std::vector<uchar> buf(static_cast<size_t>(stride) * rect.height());
+    std::vector<QRect> rowsRead;
+
+    QVERIFY(sidecar.read(1, rect, buf.data(), stride, [&](const QRect & r)
+    {
+        rowsRead.push_back(r);
+    }));
+
+    QCOMPARE(rowsRead.size(), size_t(2));
+    QCOMPARE(rowsRead[0], QRect(0, 0, 100, 56));
+    QCOMPARE(rowsRead[1], QRect(0, 56, 100, 44));
+
+    // the border between red and blue is at x = 300 on level 1
+    QCOMPARE(rgbaAt(buf, stride, 49, 0), QColor(255, 0, 0));
+    QCOMPARE(rgbaAt(buf, stride, 50, 0), QColor(0, 0, 255));
+    QCOMPARE(rgbaAt(buf, stride, 49, 99), QColor(255, 0, 0));
+    QCOMPARE(rgbaAt(buf, stride, 99, 99), QColor(0, 0, 255));
+
+    // entirely outside of the level
+    QVERIFY(!sidecar.read(1, QRect(600, 0, 10, 10), buf.data(), stride));
+    QVERIFY(!sidecar.read(4, rect, buf.data(), stride));
+}
+
+void PyramidSidecarTest::testInvalid()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QVERIFY(!PyramidSidecar(dir.filePath(QStringLiteral("missing.tif"))).isValid());
+
+    const QString garbage = dir.filePath(QStringLiteral("garbage.tif"));
+    QFile f(garbage);
+    QVERIFY(f.open(QIODevice::WriteOnly));
+    f.write("II*\0 this is not a pyramid", 26);
+    f.close();
+
+    PyramidSidecar sidecar(garbage);
+    QVERIFY(!sidecar.isValid());
+    QCOMPARE(sidecar.levels(), 0);
+
+    QVERIFY(!PyramidSidecar::generate(QImage(), dir.filePath(QStringLiteral("null.tif"))));
+    QVERIFY(!QFile::exists(dir.filePath(QStringLiteral("null.tif"))));
+}
+
+void PyramidSidecarTest::testPruneCache()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // oldest first
+    const QStringList names = { QStringLiteral("a.tif"), QStringLiteral("b.tif"), QStringLiteral("c.tif"), QStringLiteral("d.tif") };
+    const QDateTime now = QDateTime::currentDateTime();
+
+    for(int i = 0; i < names.size(); i++)
+    {
+        QFile f(dir.filePath(names[i]));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        QCOMPARE(f.write(QByteArray(1000, 'x')), qint64(1000));
+        // flush first, writing would bump the modification time again
+        QVERIFY(f.flush());
+        QVERIFY(f.setFileTime(now.addSecs(i - names.size()), QFileDevice::FileModificationTime));
+    }
+
+    // not a sidecar, must not be touched
+    QFile other(dir.filePath(QStringLiteral("unrelated.part")));
+    QVERIFY(other.open(QIODevice::WriteOnly));
+    other.write(QByteArray(1000, 'x'));
+    other.close();
+
+    PyramidSidecar::pruneCache(dir.path(), 4000);
+    QVERIFY(QFile::exists(dir.filePath(names[0])));
+
+    PyramidSidecar::pruneCache(dir.path(), 2500);
+    QVERIFY(!QFile::exists(dir.filePath(names[0])));
+    QVERIFY(!QFile::exists(dir.filePath(names[1])));
+    QVERIFY(QFile::exists(dir.filePath(names[2])));
+    QVERIFY(QFile::exists(dir.filePath(names[3])));
+
+    // the one to keep survives even if it's the oldest one
+    PyramidSidecar::pruneCache(dir.path(), 0, dir.filePath(names[2]));
+    QVERIFY(QFile::exists(dir.filePath(names[2])));
+    QVERIFY(!QFile::exists(dir.filePath(names[3])));
+    QVERIFY(QFile::exists(dir.filePath(QStringLiteral("unrelated.part"))));
+}
@@ -0,0 +1,14 @@
+
+#pragma once
+
+#include <QObject>
+
+class PyramidSidecarTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testRoundTrip();
+    void testReadAcrossTiles();
+    void testInvalid();
+    void testPruneCache();
+};
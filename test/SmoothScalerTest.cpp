@@ -0,0 +1,119 @@
+
+#include "SmoothScalerTest.hpp"
+#include "SmoothScaler.hpp"
+
+#include <QTest>
+#include <vector>
+
+QTEST_MAIN(SmoothScalerTest)
+#include "SmoothScalerTest.moc"
+
+// an image whose red channel holds the given values, row by row
+static QImage makeRedRamp(int width, int height, const std::vector<int> &reds)
+{
+    QImage img(width, height, QImage::Format_RGB32);
+
+    for(int y = 0; y < height; y++)
+    {
+        for(int x = 0; x < width; x++)
+        {
+            img.setPixel(x, y, qRgb(reds[y * width + x], 0, 0));
+        }
+    }
+
+    return img;
+}
+
+void SmoothScalerTest::testFlatColour()
+{
+    QImage src(97, 61, QImage::Format_RGB32);
+    src.fill(qRgb(10, 120, 250));
+
+    QImage dst = SmoothScaler::areaAverage(src, src.rect(), QSize(13, 7));
+    QCOMPARE(dst.size(), QSize(13, 7));
+    QCOMPARE(dst.format(), QImage::Format_RGB32);
+
+    for(int y = 0; y < dst.height(); y++)
+    {
+        for(int x = 0; x < dst.width(); x++)
+        {
+            QCOMPARE(dst.pixel(x, y), qRgb(10, 120, 250));
+        }
+    }
+
+    // never upscales
+    QCOMPARE(SmoothScaler::areaAverage(src, src.rect(), QSize(200, 200)).size(), src.size());
+    QVERIFY(SmoothScaler::areaAverage(src, QRect(), QSize(10, 10)).isNull());
+}
+
+void SmoothScalerTest::testBlockAverage()
+{
+    QImage src = makeRedRamp(4, 2,
+    {
+        0, 40, 100, 200,
+        80, 120, 100, 0,
+    });
+
+    QImage dst = SmoothScaler::areaAverage(src, src.rect(), QSize(2, 1));
+    QCOMPARE(dst.size(), QSize(2, 1));
+    QCOMPARE(qRed(dst.pixel(0, 0)), 60);
+    QCOMPARE(qRed(dst.pixel(1, 0)), 100);
+}
+
+void SmoothScalerTest::testEdgeBlocks()
+{
+    // a scale of 1.5, so the middle pixel contributes to both destination pixels
+    QImage src = makeRedRamp(3, 1, { 0, 90, 180 });
+
+    QImage dst = SmoothScaler::areaAverage(src, src.rect(), QSize(2, 1));
+    QCOMPARE(qRed(dst.pixel(0, 0)), 30);
+    QCOMPARE(qRed(dst.pixel(1, 0)), 150);
+
+    // a scale of 2.5, the last destination pixel covers half of pixel 2 and all of pixels 3 and 4
+    src = makeRedRamp(5, 1, { 0, 0, 50, 100, 200 });
+    dst = SmoothScaler::areaAverage(src, src.rect(), QSize(2, 1));
+    QCOMPARE(qRed(dst.pixel(0, 0)), 10);
+    QCOMPARE(qRed(dst.pixel(1, 0)), 130);
+}
+
+void SmoothScalerTest::testSourceRect()
+{
+    QImage src = makeRedRamp(4, 2,
+    {
+        0, 40, 100, 200,
+        80, 120, 100, 0,
+    });
+
+    QImage dst = SmoothScaler::areaAverage(src, QRect(2, 0, 2, 2), QSize(1, 1));
+    QCOMPARE(qRed(dst.pixel(0, 0)), 100);
+
+    // clipped to the image
+    dst = SmoothScaler::areaAverage(src, QRect(3, -1, 5, 5), QSize(1, 1));
+    QCOMPARE(qRed(dst.pixel(0, 0)), 100);
+}
+
+void SmoothScalerTest::testNonRgb32()
+{
+    QImage src(8, 8, QImage::Format_RGB888);
+    src.fill(QColor(200, 100, 50));
+    src.setPixelColor(7, 7, QColor(0, 0, 0));
+
+    QImage dst = SmoothScaler::areaAverage(src, QRect(0, 0, 4, 4), QSize(2, 2));
+    QCOMPARE(dst.format(), QImage::Format_ARGB32_Premultiplied);
+    QCOMPARE(dst.pixelColor(1, 1), QColor(200, 100, 50));
+
+    // a converted sub-rectangle must not lose its position
+    dst = SmoothScaler::areaAverage(src, QRect(6, 6, 2, 2), QSize(1, 1), {}, 1);
+    QCOMPARE(dst.pixelColor(0, 0), QColor(150, 75, 38));
+}
+
+void SmoothScalerTest::testCancel()
+{
+    QImage src(64, 64, QImage::Format_RGB32);
+    src.fill(Qt::white);
+
+    QVERIFY(SmoothScaler::areaAverage(src, src.rect(), QSize(8, 8), []()
+    {
+        return true;
+    }).isNull());
+}
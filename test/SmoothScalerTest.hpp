@@ -0,0 +1,16 @@
+
+#pragma once
+
+#include <QObject>
+
+class SmoothScalerTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testFlatColour();
+    void testBlockAverage();
+    void testEdgeBlocks();
+    void testSourceRect();
+    void testNonRgb32();
+    void testCancel();
+};
@@ -0,0 +1,95 @@
+
+#include "ThumbnailAtlasTest.hpp"
+#include "ThumbnailAtlas.hpp"
+
+#include <QTest>
+#include <vector>
+
+QTEST_MAIN(ThumbnailAtlasTest)
+#include "ThumbnailAtlasTest.moc"
+
+static QImage filled(int width, int height, QColor color)
+{
+    QImage img(width, height, QImage::Format_ARGB32);
+    img.fill(color);
+    return img;
+}
+
+void ThumbnailAtlasTest::testPacking()
+{
+    ThumbnailAtlas atlas;
+    QImage red = filled(200, 100, Qt::red);
+    QImage blue = filled(400, 200, Qt::blue);
+    QRect r;
+
+    const QPixmap *page = atlas.lookup(red, 100, r);
+    QVERIFY(page != nullptr);
+    QCOMPARE(r, QRect(0, 0, 200, 100));
+
+    // scaled to the height of the atlas, placed next to the previous one
+    QCOMPARE(atlas.lookup(blue, 100, r), page);
+    QCOMPARE(r, QRect(200, 0, 200, 100));
+    QCOMPARE(page->toImage().pixelColor(r.center()), QColor(Qt::blue));
+
+    // already present
+    QCOMPARE(atlas.lookup(red, 100, r), page);
+    QCOMPARE(r, QRect(0, 0, 200, 100));
+    QCOMPARE(page->toImage().pixelColor(r.center()), QColor(Qt::red));
+    QCOMPARE(atlas.pageCount(), 1);
+
+    // wraps to the next row
+    QImage wide = filled(ThumbnailAtlas::PageSize - 300, 100, Qt::green);
+    QVERIFY(atlas.lookup(wide, 100, r) != nullptr);
+    QCOMPARE(r, QRect(0, 100, ThumbnailAtlas::PageSize - 300, 100));
+
+    QCOMPARE(atlas.lookup(filled(ThumbnailAtlas::PageSize + 1, 100, Qt::green), 100, r), nullptr);
+    QCOMPARE(atlas.lookup(QImage(), 100, r), nullptr);
+}
+
+void ThumbnailAtlasTest::testEviction()
+{
+    constexpr int Size = ThumbnailAtlas::PageSize / 4;
+    constexpr int PerPage = 16;
+    ThumbnailAtlas atlas;
+    std::vector<QImage> images;
+    std::vector<const QPixmap *> pages;
+    QRect r;
+
+    for(int i = 0; i < ThumbnailAtlas::MaxPages * PerPage; i++)
+    {
+        images.push_back(filled(Size, Size, QColor(i, 0, 0)));
+        pages.push_back(atlas.lookup(images.back(), Size, r));
+        QVERIFY(pages.back() != nullptr);
+    }
+
+    QCOMPARE(atlas.pageCount(), ThumbnailAtlas::MaxPages);
+    QCOMPARE(pages[PerPage - 1], pages[0]);
+    QVERIFY(pages[PerPage] != pages[0]);
+
+    // makes the second page the least recently used one
+    QCOMPARE(atlas.lookup(images[0], Size, r), pages[0]);
+
+    QImage extra = filled(Size, Size, Qt::white);
+    QCOMPARE(atlas.lookup(extra, Size, r), pages[PerPage]);
+    QCOMPARE(r, QRect(0, 0, Size, Size));
+    QCOMPARE(atlas.pageCount(), ThumbnailAtlas::MaxPages);
+
+    // the other thumbnails of the second page are gone and added again
+    QCOMPARE(atlas.lookup(images[PerPage], Size, r), pages[PerPage]);
+    QCOMPARE(r, QRect(Size, 0, Size, Size));
+}
+
+void ThumbnailAtlasTest::testHeightChange()
+{
+    ThumbnailAtlas atlas;
+    QImage img = filled(100, 100, Qt::red);
+    QRect r;
+
+    QVERIFY(atlas.lookup(img, 100, r) != nullptr);
+    QVERIFY(atlas.lookup(filled(100, 100, Qt::blue), 100, r) != nullptr);
+    QCOMPARE(r, QRect(100, 0, 100, 100));
+
+    QVERIFY(atlas.lookup(img, 50, r) != nullptr);
+    QCOMPARE(r, QRect(0, 0, 50, 50));
+    QCOMPARE(atlas.pageCount(), 1);
+}
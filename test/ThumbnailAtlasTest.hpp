@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include <QObject>
+
+class ThumbnailAtlasTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testPacking();
+    void testEviction();
+    void testHeightChange();
+};
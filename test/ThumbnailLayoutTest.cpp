@@ -0,0 +1,106 @@
+
+#include "ThumbnailLayoutTest.hpp"
+#include "ThumbnailLayout.hpp"
+
+#include <QTest>
+#include <vector>
+
+QTEST_MAIN(ThumbnailLayoutTest)
+#include "ThumbnailLayoutTest.moc"
+
+constexpr int S = ThumbnailLayout::Section;
+
+// lays out items of the given widths, returns the number of widths queried
+static int layout(ThumbnailLayout &l, const std::vector<int> &widths, int viewportWidth = 100)
+{
+    int queried = 0;
+
+    l.setViewportWidth(viewportWidth);
+    l.setSpacing(5);
+    l.setRowHeight(20);
+    l.setSectionHeight(10);
+    l.layout([&](int i)
+    {
+        queried++;
+        return widths[i];
+    });
+
+    return queried;
+}
+
+void ThumbnailLayoutTest::testFlow()
+{
+    std::vector<int> widths{ S, 40, 40, 40, S, 30 };
+    ThumbnailLayout l;
+    l.reset(static_cast<int>(widths.size()));
+    QCOMPARE(layout(l, widths), 6);
+
+    QCOMPARE(l.rowCount(), 5);
+    QCOMPARE(l.itemRect(0), QRect(5, 5, 90, 10));
+    QCOMPARE(l.itemRect(1), QRect(5, 20, 40, 20));
+    QCOMPARE(l.itemRect(2), QRect(50, 20, 40, 20));
+    // wrapped
+    QCOMPARE(l.itemRect(3), QRect(5, 45, 40, 20));
+    // a section always starts a new row
+    QCOMPARE(l.itemRect(4), QRect(5, 70, 90, 10));
+    QCOMPARE(l.itemRect(5), QRect(5, 85, 30, 20));
+    QCOMPARE(l.contentHeight(), 110);
+    QCOMPARE(l.rowItems(1), std::make_pair(1, 2));
+    QCOMPARE(l.rowOf(3), 2);
+    QVERIFY(!l.isDirty());
+}
+
+void ThumbnailLayoutTest::testHitTesting()
+{
+    std::vector<int> widths{ S, 40, 40, 40, S, 30 };
+    ThumbnailLayout l;
+    l.reset(static_cast<int>(widths.size()));
+    layout(l, widths);
+
+    QCOMPARE(l.itemAt(QPoint(10, 10)), 0);
+    QCOMPARE(l.itemAt(QPoint(60, 30)), 2);
+    QCOMPARE(l.itemAt(QPoint(10, 50)), 3);
+    // spacing between items and between rows
+    QCOMPARE(l.itemAt(QPoint(47, 30)), -1);
+    QCOMPARE(l.itemAt(QPoint(60, 42)), -1);
+    // right of the last item of a row
+    QCOMPARE(l.itemAt(QPoint(60, 50)), -1);
+
+    QCOMPARE(l.rowAt(-10), 0);
+    QCOMPARE(l.rowAt(50), 2);
+    QCOMPARE(l.rowAt(1000), 4);
+}
+
+void ThumbnailLayoutTest::testIncrementalChanges()
+{
+    std::vector<int> widths{ S, 40, 40, 40, S, 30 };
+    ThumbnailLayout l;
+    l.reset(static_cast<int>(widths.size()));
+    layout(l, widths);
+
+    // only invalidated items are queried again
+    widths[3] = 20;
+    l.invalidate(3, 3);
+    QVERIFY(l.isDirty());
+    QCOMPARE(layout(l, widths), 1);
+    QCOMPARE(l.itemRect(3), QRect(5, 45, 20, 20));
+
+    widths.insert(widths.begin() + 1, 40);
+    l.insertItems(1, 1);
+    QCOMPARE(layout(l, widths), 1);
+    QCOMPARE(l.itemRect(1), QRect(5, 20, 40, 20));
+    QCOMPARE(l.itemRect(3), QRect(5, 45, 40, 20));
+    QCOMPARE(l.itemRect(4), QRect(50, 45, 20, 20));
+
+    widths.erase(widths.begin() + 1, widths.begin() + 3);
+    l.removeItems(1, 2);
+    QCOMPARE(l.count(), 5);
+    QCOMPARE(layout(l, widths), 0);
+    QCOMPARE(l.itemRect(2), QRect(50, 20, 20, 20));
+    QCOMPARE(l.itemRect(3), QRect(5, 45, 90, 10));
+    QCOMPARE(l.contentHeight(), 85);
+
+    // a narrower viewport flows the items again without querying them
+    QCOMPARE(layout(l, widths, 70), 0);
+    QCOMPARE(l.itemRect(2), QRect(5, 45, 20, 20));
+}
@@ -0,0 +1,13 @@
+
+#pragma once
+
+#include <QObject>
+
+class ThumbnailLayoutTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testFlow();
+    void testHitTesting();
+    void testIncrementalChanges();
+};
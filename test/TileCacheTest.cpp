@@ -0,0 +1,134 @@
+
+#include "TileCacheTest.hpp"
+#include "TileCache.hpp"
+
+#include <QTest>
+#include <QImage>
+#include <QColor>
+#include <QPainter>
+
+QTEST_MAIN(TileCacheTest)
+#include "TileCacheTest.moc"
+
+static QImage makeImage(const QRect &fullResRect, int div, QColor col)
+{
+    QImage img(fullResRect.size() / div, QImage::Format_ARGB32);
+    img.fill(col);
+    img.setOffset(fullResRect.topLeft());
+    return img;
+}
+
+void TileCacheTest::testLevelForScale()
+{
+    QCOMPARE(TileCache::levelForScale(2.0), 0);
+    QCOMPARE(TileCache::levelForScale(1.0), 0);
+    QCOMPARE(TileCache::levelForScale(0.75), 0);
+    QCOMPARE(TileCache::levelForScale(0.5), 1);
+    QCOMPARE(TileCache::levelForScale(0.3), 1);
+    QCOMPARE(TileCache::levelForScale(0.25), 2);
+    QCOMPARE(TileCache::levelForScale(0), 0);
+}
+
+void TileCacheTest::testInsertFullResolution()
+{
+    const QRect full(0, 0, 1000, 600);
+    TileCache cache(full, 1024 * 1024 * 1024);
+
+    QCOMPARE(cache.missingRect(full, 0), full);
+
+    // covers the first two tile columns entirely and the third one only partially
+    cache.insert(makeImage(QRect(0, 0, 600, 600), 1, Qt::red), QTransform());
+
+    QVERIFY(cache.missingRect(QRect(0, 0, 512, 600), 0).isEmpty());
+    QCOMPARE(cache.missingRect(full, 0), QRect(512, 0, 488, 600));
+
+    // full resolution tiles are used for coarser levels as well
+    QVERIFY(cache.missingRect(QRect(0, 0, 512, 512), 1).isEmpty());
+    QVERIFY(!cache.missingRect(QRect(0, 0, 600, 600), 1).isEmpty());
+
+    // the right border of the image is covered, even though tiles are clipped there
+    cache.insert(makeImage(QRect(500, 0, 500, 600), 1, Qt::red), QTransform());
+    QVERIFY(cache.missingRect(full, 0).isEmpty());
+}
+
+void TileCacheTest::testInsertScaled()
+{
+    const QRect full(0, 0, 2048, 2048);
+    TileCache cache(full, 1024 * 1024 * 1024);
+
+    // a quarter resolution image of the entire image
+    cache.insert(makeImage(full, 4, Qt::green), QTransform::fromScale(4, 4));
+
+    QVERIFY(cache.missingRect(full, 2).isEmpty());
+    QVERIFY(cache.missingRect(full, 3).isEmpty());
+    QCOMPARE(cache.missingRect(QRect(0, 0, 100, 100), 1), QRect(0, 0, 512, 512));
+    QCOMPARE(cache.missingRect(QRect(0, 0, 100, 100), 0), QRect(0, 0, 256, 256));
+}
+
+void TileCacheTest::testEviction()
+{
+    const QRect full(0, 0, 1024, 1024);
+    const qint64 tileBytes = TileCache::TileSize * TileCache::TileSize * 4;
+    TileCache cache(full, 4 * tileBytes);
+
+    cache.insert(makeImage(QRect(0, 0, 512, 512), 1, Qt::red), QTransform());
+    QCOMPARE(cache.sizeInBytes(), 4 * tileBytes);
+
+    // touch the top left tile, so that it survives
+    QVERIFY(cache.missingRect(QRect(0, 0, 256, 256), 0).isEmpty());
+
+    cache.insert(makeImage(QRect(512, 0, 512, 256), 1, Qt::red), QTransform());
+    QCOMPARE(cache.sizeInBytes(), 4 * tileBytes);
+    QVERIFY(cache.missingRect(QRect(0, 0, 256, 256), 0).isEmpty());
+    QVERIFY(cache.missingRect(QRect(512, 0, 512, 256), 0).isEmpty());
+    QCOMPARE(cache.missingRect(QRect(0, 0, 512, 512), 0), QRect(0, 0, 512, 512));
+
+    cache.clear();
+    QCOMPARE(cache.sizeInBytes(), 0);
+}
+
+void TileCacheTest::testPaint()
+{
+    const QRect full(0, 0, 1024, 1024);
+    TileCache cache(full, 1024 * 1024 * 1024);
+
+    cache.insert(makeImage(QRect(0, 0, 512, 1024), 2, Qt::blue), QTransform::fromScale(2, 2));
+
+    // paint a quarter of the image at a quarter of its size, i.e. the painter maps full resolution coordinates
+    QImage out(128, 128, QImage::Format_ARGB32_Premultiplied);
+    out.fill(Qt::transparent);
+    {
+        QPainter p(&out);
+        p.scale(0.25, 0.25);
+        cache.paint(p, QRect(0, 0, 512, 512), 1);
+    }
+
+    QCOMPARE(out.pixelColor(10, 10), QColor(Qt::blue));
+    QCOMPARE(out.pixelColor(120, 120), QColor(Qt::blue));
+
+    out.fill(Qt::transparent);
+    {
+        QPainter p(&out);
+        p.scale(0.25, 0.25);
+        p.translate(-512, 0);
+        cache.paint(p, QRect(512, 0, 512, 512), 1);
+    }
+
+    // not cached yet, stays transparent
+    QCOMPARE(out.pixelColor(10, 10).alpha(), 0);
+
+    // a rect across the border of the cached area, painted at the scale of level 1
+    out = QImage(300, 100, QImage::Format_ARGB32_Premultiplied);
+    out.fill(Qt::transparent);
+    {
+        QPainter p(&out);
+        p.scale(0.5, 0.5);
+        p.translate(-300, -100);
+        cache.paint(p, QRect(300, 100, 600, 200), 1);
+    }
+
+    QCOMPARE(out.pixelColor(10, 10), QColor(Qt::blue));
+    QCOMPARE(out.pixelColor(100, 90), QColor(Qt::blue));
+    QCOMPARE(out.pixelColor(110, 10).alpha(), 0);
+    QCOMPARE(out.pixelColor(290, 90).alpha(), 0);
+}
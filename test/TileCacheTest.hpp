@@ -0,0 +1,15 @@
+
+#pragma once
+
+#include <QObject>
+
+class TileCacheTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testLevelForScale();
+    void testInsertFullResolution();
+    void testInsertScaled();
+    void testEviction();
+    void testPaint();
+};